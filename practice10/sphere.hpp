@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+namespace practice10
+{
+
+struct vertex
+{
+    glm::vec3 position;
+    glm::vec3 tangent;
+    glm::vec3 normal;
+    glm::vec2 texcoords;
+};
+
+inline std::pair<std::vector<vertex>, std::vector<std::uint32_t>> generate_sphere(float radius, int quality)
+{
+    std::vector<vertex> vertices;
+
+    for (int latitude = -quality; latitude <= quality; ++latitude)
+    {
+        for (int longitude = 0; longitude <= 4 * quality; ++longitude)
+        {
+            float lat = (latitude * glm::pi<float>()) / (2.f * quality);
+            float lon = (longitude * glm::pi<float>()) / (2.f * quality);
+
+            auto & vertex = vertices.emplace_back();
+            vertex.normal = {std::cos(lat) * std::cos(lon), std::sin(lat), std::cos(lat) * std::sin(lon)};
+            vertex.position = vertex.normal * radius;
+            vertex.tangent = {-std::cos(lat) * std::sin(lon), 0.f, std::cos(lat) * std::cos(lon)};
+            vertex.texcoords.x = (longitude * 1.f) / (4.f * quality);
+            vertex.texcoords.y = (latitude * 1.f) / (2.f * quality) + 0.5f;
+        }
+    }
+
+    std::vector<std::uint32_t> indices;
+
+    for (int latitude = 0; latitude < 2 * quality; ++latitude)
+    {
+        for (int longitude = 0; longitude < 4 * quality; ++longitude)
+        {
+            std::uint32_t i0 = (latitude + 0) * (4 * quality + 1) + (longitude + 0);
+            std::uint32_t i1 = (latitude + 1) * (4 * quality + 1) + (longitude + 0);
+            std::uint32_t i2 = (latitude + 0) * (4 * quality + 1) + (longitude + 1);
+            std::uint32_t i3 = (latitude + 1) * (4 * quality + 1) + (longitude + 1);
+
+            indices.insert(indices.end(), {i0, i1, i2, i2, i1, i3});
+        }
+    }
+
+    return {std::move(vertices), std::move(indices)};
+}
+
+}
@@ -0,0 +1,148 @@
+#include "animated_bounds.hpp"
+#include "animation.hpp"
+#include "cpu_skinning.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::pair<glm::vec3, glm::vec3> animated_bounds::at(std::size_t clip_index, float time) const
+{
+    auto const & clip = clips[clip_index];
+
+    std::size_t const frame_count = clip.frames.size() / 6;
+
+    float local_time = (clip.duration > 0.f) ? std::fmod(time, clip.duration) : 0.f;
+    if (local_time < 0.f)
+        local_time += clip.duration;
+
+    std::size_t const frame = std::min<std::size_t>(local_time * sample_rate, frame_count - 1);
+
+    glm::vec3 const scale = (clip.max - clip.min) / 65535.f;
+    auto const q = clip.frames.data() + frame * 6;
+
+    return {
+        clip.min + scale * glm::vec3(q[0], q[1], q[2]),
+        clip.min + scale * glm::vec3(q[3], q[4], q[5]),
+    };
+}
+
+animated_bounds bake_animated_bounds(gltf_model const & model, std::vector<std::string> const & animation_names, float sample_rate, thread_pool * pool)
+{
+    // Poses are sampled this many times per frame, so that fast motion
+    // between two frames is still covered
+    static constexpr std::size_t substeps = 4;
+
+    static constexpr float inf = std::numeric_limits<float>::infinity();
+
+    animated_bounds result;
+    result.sample_rate = sample_rate;
+
+    for (auto const & name : animation_names)
+    {
+        auto const & animation = model.animations.at(name);
+
+        auto & clip = result.clips.emplace_back();
+        // Wrapped at the same period as the crowd and the vertex animation
+        // textures, so the bounds stay in step with the poses over many loops
+        clip.duration = loop_duration(animation);
+
+        // The last frame may extend past the end of the clip, its samples
+        // then wrap around to the start like the playback does
+        std::size_t const frame_count = std::max<std::size_t>(1, std::ceil(clip.duration * sample_rate));
+        std::size_t const sample_count = frame_count * substeps + 1;
+
+        std::vector<glm::vec3> sample_min(sample_count, glm::vec3(inf));
+        std::vector<glm::vec3> sample_max(sample_count, glm::vec3(-inf));
+
+        auto sample = [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<bone_transform> palette(model.bones.size());
+            skinned_vertices vertices;
+
+            for (std::size_t s = begin; s < end; ++s)
+            {
+                compute_bone_palette(model, animation, s / (sample_rate * substeps), palette);
+
+                for (auto const & mesh : model.meshes)
+                {
+                    skin_vertices(model, mesh, palette, vertices);
+                    for (auto const & p : vertices.positions)
+                    {
+                        sample_min[s] = glm::min(sample_min[s], p);
+                        sample_max[s] = glm::max(sample_max[s], p);
+                    }
+                }
+            }
+        };
+
+        if (pool)
+            pool->parallel_for(sample_count, 4, sample);
+        else
+            sample(0, sample_count);
+
+        // Neighbouring frames share their boundary sample. Poses between two
+        // samples can still poke out of both, so frames are padded by how
+        // much the bounds move from one sample to the next
+        std::vector<glm::vec3> frame_min(frame_count, glm::vec3(inf));
+        std::vector<glm::vec3> frame_max(frame_count, glm::vec3(-inf));
+        for (std::size_t f = 0; f < frame_count; ++f)
+        {
+            glm::vec3 margin(0.f);
+            for (std::size_t s = f * substeps; s <= (f + 1) * substeps; ++s)
+            {
+                frame_min[f] = glm::min(frame_min[f], sample_min[s]);
+                frame_max[f] = glm::max(frame_max[f], sample_max[s]);
+
+                if (s > f * substeps)
+                    margin = glm::max(margin, glm::max(glm::abs(sample_min[s] - sample_min[s - 1]), glm::abs(sample_max[s] - sample_max[s - 1])));
+            }
+
+            frame_min[f] -= margin;
+            frame_max[f] += margin;
+        }
+
+        clip.min = glm::vec3(inf);
+        clip.max = glm::vec3(-inf);
+        for (std::size_t f = 0; f < frame_count; ++f)
+        {
+            clip.min = glm::min(clip.min, frame_min[f]);
+            clip.max = glm::max(clip.max, frame_max[f]);
+        }
+
+        glm::vec3 const extent = glm::max(clip.max - clip.min, glm::vec3(1e-6f));
+
+        clip.frames.resize(frame_count * 6);
+        for (std::size_t f = 0; f < frame_count; ++f)
+        {
+            glm::vec3 const q_min = glm::floor((frame_min[f] - clip.min) / extent * 65535.f);
+            glm::vec3 const q_max = glm::ceil((frame_max[f] - clip.min) / extent * 65535.f);
+
+            for (int c = 0; c < 3; ++c)
+            {
+                clip.frames[f * 6 + c] = std::clamp(q_min[c], 0.f, 65535.f);
+                clip.frames[f * 6 + 3 + c] = std::clamp(q_max[c], 0.f, 65535.f);
+            }
+        }
+    }
+
+    return result;
+}
+
+std::pair<glm::vec3, glm::vec3> transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max)
+{
+    // Every column of the matrix moves the box by the smaller or the larger
+    // of its two contributions
+    glm::vec3 result_min = transform[3];
+    glm::vec3 result_max = transform[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec3 const a = glm::vec3(transform[i]) * min[i];
+        glm::vec3 const b = glm::vec3(transform[i]) * max[i];
+        result_min += glm::min(a, b);
+        result_max += glm::max(a, b);
+    }
+
+    return {result_min, result_max};
+}
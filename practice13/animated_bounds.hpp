@@ -0,0 +1,45 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Bounding boxes of a skinned model over its animation clips.
+//
+// The bind pose bounds from the glTF accessors don't contain the animated
+// poses, so each clip is sampled offline and its bounds are stored per
+// frame. The box of frame i contains every pose between times
+// i / sample_rate and (i + 1) / sample_rate, so a lookup is a single
+// conservative read with no interpolation.
+struct animated_bounds
+{
+    struct clip
+    {
+        float duration;
+
+        // Union of all frames, also the quantization range of the frames
+        glm::vec3 min;
+        glm::vec3 max;
+
+        // Six values per frame: the frame min and max quantized to 16 bits
+        // within the clip bounds, rounded outwards
+        std::vector<std::uint16_t> frames;
+    };
+
+    float sample_rate;
+
+    // Indexed like the animation names given to the bake
+    std::vector<clip> clips;
+
+    // Model space bounds of the clip at the given time, wrapped to the clip length
+    std::pair<glm::vec3, glm::vec3> at(std::size_t clip, float time) const;
+};
+
+animated_bounds bake_animated_bounds(gltf_model const & model, std::vector<std::string> const & animation_names, float sample_rate = 30.f, thread_pool * pool = nullptr);
+
+// Bounds of the transformed box
+std::pair<glm::vec3, glm::vec3> transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max);
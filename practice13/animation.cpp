@@ -0,0 +1,63 @@
+#include "animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtx/transform.hpp>
+
+template <typename T>
+static T sample(gltf_model::spline<T> const & spline, float time, T const & default_value)
+{
+    if (spline.values.empty())
+        return default_value;
+    return spline(time);
+}
+
+bone_transform to_bone_transform(glm::mat4 const & m)
+{
+    return bone_transform(glm::transpose(m));
+}
+
+glm::mat4 to_mat4(bone_transform const & m)
+{
+    return glm::transpose(glm::mat4(m[0], m[1], m[2], glm::vec4(0.f, 0.f, 0.f, 1.f)));
+}
+
+float loop_duration(gltf_model::animation const & animation)
+{
+    return std::max(1.f, std::round(animation.max_time * loop_frame_rate)) / loop_frame_rate;
+}
+
+void compute_global_transforms(gltf_model const & model, gltf_model::animation const & animation, float time, std::span<glm::mat4> result)
+{
+    assert(result.size() == model.bones.size());
+
+    if (animation.max_time > 0.f)
+        time = std::fmod(time, animation.max_time);
+
+    for (std::size_t i = 0; i < model.bones.size(); ++i)
+    {
+        auto const & bone_animation = animation.bones[i];
+
+        glm::mat4 translation = glm::translate(sample(bone_animation.translation, time, glm::vec3(0.f)));
+        glm::mat4 rotation = glm::toMat4(sample(bone_animation.rotation, time, glm::quat(1.f, 0.f, 0.f, 0.f)));
+        glm::mat4 scale = glm::scale(sample(bone_animation.scale, time, glm::vec3(1.f)));
+
+        result[i] = translation * rotation * scale;
+
+        // Bones are sorted so that parents come first
+        if (auto parent = model.bones[i].parent; parent != -1)
+            result[i] = result[parent] * result[i];
+    }
+}
+
+void compute_bone_palette(gltf_model const & model, gltf_model::animation const & animation, float time, std::span<bone_transform> result)
+{
+    assert(result.size() == model.bones.size());
+
+    std::vector<glm::mat4> global(model.bones.size());
+    compute_global_transforms(model, animation, time, global);
+
+    for (std::size_t i = 0; i < model.bones.size(); ++i)
+        result[i] = to_bone_transform(global[i] * model.bones[i].inverse_bind_matrix);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <span>
+
+#include <glm/mat3x4.hpp>
+
+// Affine bone transform stored as its first three rows, i.e. as the
+// transpose of a mat4x3. This is the layout of the GPU bone palette:
+// 48 bytes per bone, std140-compatible, and vec4(p, 1.0) * m in GLSL
+// gives the transformed point.
+using bone_transform = glm::mat3x4;
+
+bone_transform to_bone_transform(glm::mat4 const & m);
+glm::mat4 to_mat4(bone_transform const & m);
+
+// Looping clips are played with a period of a whole number of frames at
+// this rate instead of their exact length. Everything that plays or
+// samples them (the crowd, vertex animation textures, animated bounds)
+// uses rates that are multiples of it, so they all wrap at the same time
+constexpr float loop_frame_rate = 30.f;
+
+// Period of the animation when it loops, max_time rounded to the nearest
+// frame at loop_frame_rate
+float loop_duration(gltf_model::animation const & animation);
+
+// Samples the animation at the given time (wrapped to the clip length) and
+// writes the global transform of every bone into result
+void compute_global_transforms(gltf_model const & model, gltf_model::animation const & animation, float time, std::span<glm::mat4> result);
+
+// Same as above, but multiplied by the inverse bind matrices, i.e. ready
+// to be used for linear blend skinning
+void compute_bone_palette(gltf_model const & model, gltf_model::animation const & animation, float time, std::span<bone_transform> result);
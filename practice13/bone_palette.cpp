@@ -0,0 +1,102 @@
+#include "bone_palette.hpp"
+
+#include <numeric>
+
+bone_palette::bone_palette(std::size_t bone_count, std::size_t max_instances)
+    : bone_count(bone_count)
+    , max_instances(max_instances)
+{
+    GLint max_block_size;
+    GLint alignment;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_block_size);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    std::size_t const bone_size = sizeof(bone_transform);
+
+    // Instance offsets must be multiples of both the bone size and the
+    // uniform buffer binding alignment
+    std::size_t const granularity = std::lcm(bone_size, static_cast<std::size_t>(alignment)) / bone_size;
+    std::size_t const padded_bone_count = (bone_count + granularity - 1) / granularity * granularity;
+
+    texture_buffer = (max_instances * padded_bone_count * bone_size > static_cast<std::size_t>(max_block_size));
+
+    instance_stride = texture_buffer ? bone_count : padded_bone_count;
+    instances_per_draw = max_instances;
+
+    data.resize(max_instances * instance_stride);
+
+    glGenBuffers(1, &buffer);
+
+    if (texture_buffer)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * bone_size, nullptr, GL_STREAM_DRAW);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    }
+    else
+    {
+        // The bound range always has the size of the whole uniform block,
+        // so leave enough space after the last instance
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, (2 * max_instances - 1) * instance_stride * bone_size, nullptr, GL_STREAM_DRAW);
+    }
+}
+
+std::string bone_palette::shader_defines() const
+{
+    if (texture_buffer)
+        return "#define BONE_PALETTE_TEXTURE_BUFFER\n";
+    return "#define BONE_PALETTE_SIZE " + std::to_string(instances_per_draw * instance_stride) + "\n";
+}
+
+void bone_palette::setup_program(GLuint program) const
+{
+    if (texture_buffer)
+        glUniform1i(glGetUniformLocation(program, "bone_palette"), texture_unit);
+    else
+        glUniformBlockBinding(program, glGetUniformBlockIndex(program, "BonePalette"), uniform_block_binding);
+
+    glUniform1i(glGetUniformLocation(program, "palette_stride"), instance_stride);
+}
+
+std::span<bone_transform> bone_palette::instance(std::size_t index)
+{
+    assert(index < max_instances);
+    return {data.data() + index * instance_stride, bone_count};
+}
+
+void bone_palette::upload(std::size_t instance_count)
+{
+    assert(instance_count <= max_instances);
+
+    GLenum const target = texture_buffer ? GL_TEXTURE_BUFFER : GL_UNIFORM_BUFFER;
+
+    GLint size;
+    glBindBuffer(target, buffer);
+    glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+
+    // Orphan the previous storage so that we don't wait for the draw calls
+    // of the previous frame that still read from it
+    glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, instance_count * instance_stride * sizeof(bone_transform), data.data());
+}
+
+void bone_palette::bind(GLint palette_offset_location, std::size_t first_instance) const
+{
+    if (texture_buffer)
+    {
+        glActiveTexture(GL_TEXTURE0 + texture_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(palette_offset_location, first_instance * instance_stride);
+    }
+    else
+    {
+        std::size_t const block_size = instances_per_draw * instance_stride * sizeof(bone_transform);
+        glBindBufferRange(GL_UNIFORM_BUFFER, uniform_block_binding, buffer, first_instance * instance_stride * sizeof(bone_transform), block_size);
+        glUniform1i(palette_offset_location, 0);
+    }
+}
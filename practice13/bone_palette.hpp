@@ -0,0 +1,56 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "animation.hpp"
+
+// GPU storage for the skinning palettes of all animated instances.
+//
+// Palettes of all instances are packed into one buffer and uploaded once per
+// frame. If every instance fits into a single uniform block, the palette is
+// a uniform buffer; otherwise (large skeletons or crowds) it is a texture
+// buffer that has no practical size limit. In both cases the shader finds
+// the palette of an instance as palette_offset + gl_InstanceID * palette_stride,
+// so instanced draws work without per-instance state changes.
+struct bone_palette
+{
+    static constexpr GLuint uniform_block_binding = 0;
+    static constexpr GLint texture_unit = 1;
+
+    std::size_t bone_count;
+    std::size_t max_instances;
+
+    // Distance between consecutive instances, in bones
+    std::size_t instance_stride;
+    // Maximal instance count of a single draw call
+    std::size_t instances_per_draw;
+
+    bool texture_buffer;
+
+    GLuint buffer;
+    GLuint texture = 0;
+
+    std::vector<bone_transform> data;
+
+    bone_palette(std::size_t bone_count, std::size_t max_instances);
+
+    // Preprocessor definitions that select the matching path in the skinning
+    // shader; should be inserted right after the #version line
+    std::string shader_defines() const;
+
+    // Binds the uniform block or the texture sampler of the program to the
+    // palette, the program must be in use
+    void setup_program(GLuint program) const;
+
+    std::span<bone_transform> instance(std::size_t index);
+
+    void upload(std::size_t instance_count);
+
+    // Makes the palettes starting from first_instance visible to the program
+    // in use; at most instances_per_draw instances can be drawn after that
+    void bind(GLint palette_offset_location, std::size_t first_instance) const;
+};
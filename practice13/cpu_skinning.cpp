@@ -0,0 +1,211 @@
+#include "cpu_skinning.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define CPU_SKINNING_AVX2
+#endif
+
+namespace
+{
+
+    // Raw pointers into the model buffer and the output streams
+    struct skinning_streams
+    {
+        glm::vec3 const * positions;
+        glm::vec3 const * normals;
+        unsigned char const * joints;
+        unsigned int joint_size;
+        glm::vec4 const * weights;
+        float const * palette;
+
+        glm::vec3 * result_positions;
+        glm::vec3 * result_normals;
+    };
+
+    // Attributes that are packed floats are read in place, others are
+    // converted into the scratch vectors of the result first
+    template <typename T>
+    T const * float_stream(gltf_model const & model, gltf_model::accessor const & accessor, std::vector<T> & scratch)
+    {
+        std::size_t const components = sizeof(T) / sizeof(float);
+        if (is_packed_float_accessor(accessor, components))
+        {
+            if (accessor.view.offset + accessor.count * sizeof(T) > model.buffer.size())
+                throw std::runtime_error("Accessor data is out of the buffer bounds");
+            return reinterpret_cast<T const *>(model.buffer.data() + accessor.view.offset);
+        }
+
+        scratch = read_float_accessor<T>(model, accessor);
+        return scratch.data();
+    }
+
+    skinning_streams make_streams(gltf_model const & model, gltf_model::mesh const & mesh, std::span<bone_transform const> palette, skinned_vertices & result)
+    {
+        std::size_t const count = mesh.position.count;
+        if (mesh.normal.count != count || mesh.joints.count != count || mesh.weights.count != count)
+            throw std::runtime_error("Mesh " + mesh.name + " has no skin or attributes of different sizes");
+
+        result.positions.resize(count);
+        result.normals.resize(count);
+
+        skinning_streams streams;
+        streams.positions = float_stream(model, mesh.position, result.source_positions);
+        streams.normals = float_stream(model, mesh.normal, result.source_normals);
+        streams.weights = float_stream(model, mesh.weights, result.source_weights);
+
+        std::size_t const joint_size = (mesh.joints.type == 0x1401) ? 1 : 2; // GL_UNSIGNED_BYTE
+        // Unsigned bytes or shorts, four per vertex, not interleaved
+        bool const packed_joints = (mesh.joints.type == 0x1401 || mesh.joints.type == 0x1403) && mesh.joints.size == 4
+            && (mesh.joints.view.stride == 0 || mesh.joints.view.stride == 4 * joint_size)
+            && mesh.joints.view.offset + count * 4 * joint_size <= model.buffer.size();
+        if (packed_joints)
+        {
+            streams.joints = reinterpret_cast<unsigned char const *>(model.buffer.data() + mesh.joints.view.offset);
+            streams.joint_size = joint_size;
+        }
+        else
+        {
+            result.source_joints = read_joint_accessor(model, mesh.joints);
+            streams.joints = reinterpret_cast<unsigned char const *>(result.source_joints.data());
+            streams.joint_size = 2;
+        }
+
+        streams.palette = reinterpret_cast<float const *>(palette.data());
+        streams.result_positions = result.positions.data();
+        streams.result_normals = result.normals.data();
+        return streams;
+    }
+
+    unsigned int joint(skinning_streams const & s, std::size_t vertex, int k)
+    {
+        auto p = s.joints + (4 * vertex + k) * s.joint_size;
+        if (s.joint_size == 1)
+            return *p;
+        return *reinterpret_cast<std::uint16_t const *>(p);
+    }
+
+    void skin_range_scalar(skinning_streams const & s, std::size_t begin, std::size_t end)
+    {
+        auto palette = reinterpret_cast<bone_transform const *>(s.palette);
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            glm::vec4 const w = s.weights[i];
+
+            bone_transform const m = w.x * palette[joint(s, i, 0)]
+                + w.y * palette[joint(s, i, 1)]
+                + w.z * palette[joint(s, i, 2)]
+                + w.w * palette[joint(s, i, 3)];
+
+            s.result_positions[i] = glm::vec4(s.positions[i], 1.f) * m;
+            s.result_normals[i] = glm::normalize(glm::vec3(glm::vec4(s.normals[i], 0.f) * m));
+        }
+    }
+
+#ifdef CPU_SKINNING_AVX2
+
+    // The palette transposed to columns (x, y, z, 0), two columns per
+    // register: blending a bone then takes two FMAs, and transforming a
+    // point is column0 * x + column1 * y + column2 * z + column3, with no
+    // horizontal operations and no gathers
+    struct alignas(32) bone_columns
+    {
+        float c01[8];
+        float c23[8];
+    };
+
+    std::vector<bone_columns> palette_columns(skinning_streams const & s, std::size_t bone_count)
+    {
+        auto palette = reinterpret_cast<bone_transform const *>(s.palette);
+
+        std::vector<bone_columns> result(bone_count);
+        for (std::size_t b = 0; b < bone_count; ++b)
+        {
+            auto const & m = palette[b];
+            result[b] = {
+                {m[0][0], m[1][0], m[2][0], 0.f, m[0][1], m[1][1], m[2][1], 0.f},
+                {m[0][2], m[1][2], m[2][2], 0.f, m[0][3], m[1][3], m[2][3], 0.f},
+            };
+        }
+        return result;
+    }
+
+    void skin_range_avx2(skinning_streams const & s, std::vector<bone_columns> const & columns, std::size_t begin, std::size_t end)
+    {
+        alignas(16) float out[4];
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            __m256 c01 = _mm256_setzero_ps();
+            __m256 c23 = _mm256_setzero_ps();
+
+            auto const weights = reinterpret_cast<float const *>(s.weights + i);
+            for (int k = 0; k < 4; ++k)
+            {
+                __m256 const w = _mm256_broadcast_ss(weights + k);
+                auto const j = joint(s, i, k);
+                c01 = _mm256_fmadd_ps(w, _mm256_load_ps(columns[j].c01), c01);
+                c23 = _mm256_fmadd_ps(w, _mm256_load_ps(columns[j].c23), c23);
+            }
+
+            auto const & p = s.positions[i];
+            __m256 position = _mm256_mul_ps(c01, _mm256_setr_m128(_mm_set1_ps(p.x), _mm_set1_ps(p.y)));
+            position = _mm256_fmadd_ps(c23, _mm256_setr_m128(_mm_set1_ps(p.z), _mm_set1_ps(1.f)), position);
+            __m128 const result_position = _mm_add_ps(_mm256_castps256_ps128(position), _mm256_extractf128_ps(position, 1));
+
+            auto const & n = s.normals[i];
+            __m256 normal = _mm256_mul_ps(c01, _mm256_setr_m128(_mm_set1_ps(n.x), _mm_set1_ps(n.y)));
+            normal = _mm256_fmadd_ps(c23, _mm256_setr_m128(_mm_set1_ps(n.z), _mm_setzero_ps()), normal);
+            __m128 result_normal = _mm_add_ps(_mm256_castps256_ps128(normal), _mm256_extractf128_ps(normal, 1));
+            result_normal = _mm_div_ps(result_normal, _mm_sqrt_ps(_mm_dp_ps(result_normal, result_normal, 0x7f)));
+
+            // Full 16-byte stores would overwrite the next vertex, which may
+            // belong to another thread's chunk
+            _mm_store_ps(out, result_position);
+            s.result_positions[i] = {out[0], out[1], out[2]};
+            _mm_store_ps(out, result_normal);
+            s.result_normals[i] = {out[0], out[1], out[2]};
+        }
+    }
+
+#endif
+
+}
+
+void skin_vertices_reference(gltf_model const & model, gltf_model::mesh const & mesh, std::span<bone_transform const> palette, skinned_vertices & result)
+{
+    auto const streams = make_streams(model, mesh, palette, result);
+    skin_range_scalar(streams, 0, mesh.position.count);
+}
+
+void skin_vertices(gltf_model const & model, gltf_model::mesh const & mesh, std::span<bone_transform const> palette, skinned_vertices & result, thread_pool * pool)
+{
+    auto const streams = make_streams(model, mesh, palette, result);
+
+#ifdef CPU_SKINNING_AVX2
+    auto const columns = palette_columns(streams, palette.size());
+    auto skin_range = [&](std::size_t begin, std::size_t end){ skin_range_avx2(streams, columns, begin, end); };
+#else
+    auto skin_range = [&](std::size_t begin, std::size_t end){ skin_range_scalar(streams, begin, end); };
+#endif
+
+    // Large enough to amortize the task overhead
+    static constexpr std::size_t chunk_size = 2048;
+
+    if (pool && mesh.position.count > chunk_size)
+        pool->parallel_for(mesh.position.count, chunk_size, skin_range);
+    else
+        skin_range(0, mesh.position.count);
+}
+
+bool skin_vertices_simd_enabled()
+{
+#ifdef CPU_SKINNING_AVX2
+    return true;
+#else
+    return false;
+#endif
+}
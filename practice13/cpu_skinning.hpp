@@ -0,0 +1,35 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "animation.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Skinned vertex streams of a single mesh, laid out exactly like the glTF
+// POSITION and NORMAL attributes, so they can be uploaded to a VBO as is
+struct skinned_vertices
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+
+    // Copies of the mesh attributes as packed floats and 16-bit joints,
+    // for quantized or interleaved meshes whose data can't be read in place
+    std::vector<glm::vec3> source_positions;
+    std::vector<glm::vec3> source_normals;
+    std::vector<glm::vec4> source_weights;
+    std::vector<std::uint16_t> source_joints;
+};
+
+// One vertex at a time, used as the reference implementation
+void skin_vertices_reference(gltf_model const & model, gltf_model::mesh const & mesh, std::span<bone_transform const> palette, skinned_vertices & result);
+
+// Blends and applies the bone matrices with AVX2 (or falls back to the
+// reference kernel if it isn't available) and splits the vertices into
+// chunks that are processed on the pool threads, if a pool is given
+void skin_vertices(gltf_model const & model, gltf_model::mesh const & mesh, std::span<bone_transform const> palette, skinned_vertices & result, thread_pool * pool = nullptr);
+
+// Whether skin_vertices uses the SIMD kernel in this build
+bool skin_vertices_simd_enabled();
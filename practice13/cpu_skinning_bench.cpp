@@ -0,0 +1,129 @@
+// Headless CPU skinning benchmark: no window or GL context is needed, so it
+// runs on machines without a GPU. Compares the SIMD and multithreaded
+// kernels against the scalar reference on the wolf model.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#include "gltf_loader.hpp"
+#include "animation.hpp"
+#include "cpu_skinning.hpp"
+#include "thread_pool.hpp"
+
+// A model whose only mesh contains all wolf meshes repeated `copies` times,
+// so that there is enough work to spread over the threads
+static gltf_model make_large_model(gltf_model const & source, int copies)
+{
+    gltf_model result;
+    result.bones = source.bones;
+
+    auto & mesh = result.meshes.emplace_back();
+    mesh.name = "large";
+
+    std::vector<gltf_model::accessor gltf_model::mesh::*> const attributes = {
+        &gltf_model::mesh::position,
+        &gltf_model::mesh::normal,
+        &gltf_model::mesh::joints,
+        &gltf_model::mesh::weights,
+    };
+
+    for (auto attribute : attributes)
+    {
+        auto & accessor = mesh.*attribute;
+        accessor = source.meshes[0].*attribute;
+        accessor.view.offset = result.buffer.size();
+        accessor.count = 0;
+
+        for (int i = 0; i < copies; ++i)
+        {
+            for (auto const & source_mesh : source.meshes)
+            {
+                auto const & source_accessor = source_mesh.*attribute;
+                assert(source_accessor.type == accessor.type);
+
+                auto begin = source.buffer.begin() + source_accessor.view.offset;
+                result.buffer.insert(result.buffer.end(), begin, begin + source_accessor.view.size);
+                accessor.count += source_accessor.count;
+            }
+        }
+
+        accessor.view.size = result.buffer.size() - accessor.view.offset;
+    }
+
+    return result;
+}
+
+template <typename F>
+static double measure(F && f)
+{
+    // Run for at least half a second to get a stable number
+    int iterations = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed{0.0};
+    while (elapsed.count() < 0.5)
+    {
+        f();
+        ++iterations;
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+    }
+    return elapsed.count() / iterations;
+}
+
+static float max_difference(std::vector<glm::vec3> const & a, std::vector<glm::vec3> const & b)
+{
+    float result = 0.f;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        result = std::max(result, glm::length(a[i] - b[i]));
+    return result;
+}
+
+int main() try
+{
+    const std::string project_root = PROJECT_ROOT;
+    auto const wolf = load_gltf(project_root + "/wolf/Wolf-Blender-2.82a.gltf");
+
+    std::vector<bone_transform> palette(wolf.bones.size());
+    compute_bone_palette(wolf, wolf.animations.begin()->second, 0.5f, palette);
+
+    thread_pool pool;
+
+    std::cout << "SIMD kernel: " << (skin_vertices_simd_enabled() ? "AVX2" : "disabled") << ", threads: " << pool.size() << std::endl;
+    std::cout << std::left << std::setw(12) << "vertices"
+        << std::setw(24) << "reference, Mvert/s"
+        << std::setw(24) << "SIMD, Mvert/s"
+        << std::setw(24) << "SIMD + threads, Mvert/s"
+        << "max error" << std::endl;
+
+    for (int copies : {1, 16, 256})
+    {
+        auto const model = make_large_model(wolf, copies);
+        auto const & mesh = model.meshes[0];
+
+        skinned_vertices reference, simd, threaded;
+
+        double const reference_time = measure([&]{ skin_vertices_reference(model, mesh, palette, reference); });
+        double const simd_time = measure([&]{ skin_vertices(model, mesh, palette, simd); });
+        double const threaded_time = measure([&]{ skin_vertices(model, mesh, palette, threaded, &pool); });
+
+        float const error = std::max({
+            max_difference(reference.positions, simd.positions),
+            max_difference(reference.normals, simd.normals),
+            max_difference(reference.positions, threaded.positions),
+        });
+
+        auto throughput = [&](double time){ return mesh.position.count / time * 1e-6; };
+
+        std::cout << std::left << std::setw(12) << mesh.position.count
+            << std::setw(24) << throughput(reference_time)
+            << std::setw(24) << throughput(simd_time)
+            << std::setw(24) << throughput(threaded_time)
+            << error << std::endl;
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
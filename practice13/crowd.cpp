@@ -0,0 +1,93 @@
+#include "crowd.hpp"
+
+#include <cmath>
+
+crowd::crowd(gltf_model const & model, std::vector<std::string> const & animation_names)
+    : model(&model)
+{
+    for (auto const & name : animation_names)
+        animations.push_back(&model.animations.at(name));
+}
+
+std::size_t crowd::pose(std::size_t animation, std::uint32_t frame, crowd_stats & stats)
+{
+    std::size_t const bone_count = model->bones.size();
+
+    std::uint64_t const key = (static_cast<std::uint64_t>(animation) << 32) | frame;
+
+    if (auto it = pose_index_.find(key); it != pose_index_.end())
+    {
+        ++stats.poses_reused;
+        return it->second;
+    }
+
+    std::size_t const index = pose_index_.size();
+    pose_index_[key] = index;
+    poses_.resize((index + 1) * bone_count);
+
+    compute_bone_palette(*model, *animations[animation], frame / sample_rate, std::span{poses_.data() + index * bone_count, bone_count});
+    ++stats.poses_evaluated;
+    return index;
+}
+
+crowd_stats crowd::update(float time, glm::vec3 const & camera_position, std::span<std::uint32_t const> visible,
+    std::span<bone_transform> palettes, std::size_t instance_stride)
+{
+    assert(palettes.size() >= visible.size() * instance_stride);
+
+    std::size_t const bone_count = model->bones.size();
+
+    crowd_stats stats;
+    stats.instances_per_lod.assign(lod_count, 0);
+
+    if (pose_index_.size() + 2 * visible.size() > max_cached_poses)
+    {
+        pose_index_.clear();
+        poses_.clear();
+    }
+
+    for (std::size_t i = 0; i < visible.size(); ++i)
+    {
+        auto const & instance = instances[visible[i]];
+
+        float const distance = glm::distance(camera_position, glm::vec3(instance.transform[3]));
+
+        std::size_t lod = 0;
+        while (lod + 1 < lod_count && distance > lod_distances[lod])
+            ++lod;
+        ++stats.instances_per_lod[lod];
+
+        float const duration = loop_duration(*animations[instance.animation]);
+        std::uint32_t const frame_count = std::round(duration * sample_rate);
+
+        float const local_time = std::fmod(time + instance.phase, duration);
+        std::uint32_t const step = 1u << lod;
+
+        // Position on the grid of this LOD, in frames
+        float const position = local_time * sample_rate / step;
+        std::uint32_t const frame0 = static_cast<std::uint32_t>(position) * step;
+        std::uint32_t const frame1 = (frame0 + step) % frame_count;
+        float const t = position - std::floor(position);
+
+        auto result = palettes.subspan(i * instance_stride, bone_count);
+
+        if (lod == 0)
+        {
+            // The grid is fine enough to snap to the nearest frame
+            auto const p = poses_.data() + pose(instance.animation, (t < 0.5f) ? frame0 % frame_count : frame1, stats) * bone_count;
+            std::copy(p, p + bone_count, result.begin());
+            continue;
+        }
+
+        // Both lookups may grow the cache, so take the pointers afterwards
+        std::size_t const index0 = pose(instance.animation, frame0 % frame_count, stats);
+        std::size_t const index1 = pose(instance.animation, frame1, stats);
+        auto const p0 = poses_.data() + index0 * bone_count;
+        auto const p1 = poses_.data() + index1 * bone_count;
+
+        for (std::size_t b = 0; b < bone_count; ++b)
+            result[b] = p0[b] * (1.f - t) + p1[b] * t;
+    }
+
+    return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "animation.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct crowd_instance
+{
+    std::size_t animation;
+    float phase = 0.f;
+    glm::mat4 transform{1.f};
+};
+
+struct crowd_stats
+{
+    // Poses sampled from the animation splines this frame
+    std::size_t poses_evaluated = 0;
+    // Pose lookups served from the cache
+    std::size_t poses_reused = 0;
+    std::vector<std::size_t> instances_per_lod;
+};
+
+// Animates many instances of one skinned model.
+//
+// Poses are sampled on a fixed time grid and cached by (animation, frame),
+// so instances that play the same clip with the same phase share a single
+// pose evaluation. Instances further from the camera switch to coarser
+// grids (every 2nd, 4th, ... frame) and interpolate between the two
+// neighbouring cached poses, so they almost always hit the cache as well.
+// The resulting palettes are written into one packed array that can be
+// uploaded to a bone_palette and drawn with a single instanced draw call.
+struct crowd
+{
+    static constexpr float sample_rate = 60.f;
+    static_assert(sample_rate / loop_frame_rate == float(int(sample_rate / loop_frame_rate)), "sample_rate must be a multiple of loop_frame_rate");
+    static constexpr std::size_t lod_count = 4;
+
+    gltf_model const * model;
+    std::vector<gltf_model::animation const *> animations;
+    std::vector<crowd_instance> instances;
+
+    // Instances beyond lod_distances[i] use LOD i + 1, i.e. update their
+    // poses 2^(i + 1) times less often
+    std::array<float, lod_count - 1> lod_distances = {2.f, 4.f, 8.f};
+
+    // The cache is dropped once it holds this many poses
+    std::size_t max_cached_poses = 4096;
+
+    crowd(gltf_model const & model, std::vector<std::string> const & animation_names);
+
+    // Writes the palette of instance visible[i] to palettes[i * instance_stride ...],
+    // instances that aren't listed aren't animated at all
+    crowd_stats update(float time, glm::vec3 const & camera_position, std::span<std::uint32_t const> visible,
+        std::span<bone_transform> palettes, std::size_t instance_stride);
+
+private:
+    std::unordered_map<std::uint64_t, std::size_t> pose_index_;
+    std::vector<bone_transform> poses_;
+
+    // Index of the cached pose, evaluating it if necessary
+    std::size_t pose(std::size_t animation, std::uint32_t frame, crowd_stats & stats);
+};
@@ -0,0 +1,121 @@
+#include "gl_state.hpp"
+
+template <typename T>
+bool gl_state::update(std::optional<T> & current, T const & value)
+{
+    if (current == value)
+    {
+        ++counters_.filtered;
+        return false;
+    }
+
+    current = value;
+    ++counters_.issued;
+    return true;
+}
+
+void gl_state::enable(GLenum capability, bool enabled)
+{
+    if (!update(enabled_[capability], enabled))
+        return;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void gl_state::blend_func(GLenum source, GLenum destination)
+{
+    if (update(blend_func_, std::pair{source, destination}))
+        glBlendFunc(source, destination);
+}
+
+void gl_state::depth_func(GLenum function)
+{
+    if (update(depth_func_, function))
+        glDepthFunc(function);
+}
+
+void gl_state::depth_mask(bool write)
+{
+    if (update(depth_mask_, write))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void gl_state::cull_face(GLenum face)
+{
+    if (update(cull_face_, face))
+        glCullFace(face);
+}
+
+void gl_state::use_program(GLuint program)
+{
+    if (update(program_, program))
+        glUseProgram(program);
+}
+
+void gl_state::bind_vertex_array(GLuint vao)
+{
+    if (!update(vertex_array_, vao))
+        return;
+
+    glBindVertexArray(vao);
+    buffers_.erase(GL_ELEMENT_ARRAY_BUFFER);
+}
+
+void gl_state::bind_buffer(GLenum target, GLuint buffer)
+{
+    if (update(buffers_[target], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void gl_state::bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    auto & current = textures_[{unit, target}];
+    if (current == texture)
+    {
+        ++counters_.filtered;
+        return;
+    }
+
+    // Selecting the unit is part of this bind, not a call the caller asked
+    // for, so it is only counted when it is issued
+    if (active_texture_ != unit)
+    {
+        active_texture_ = unit;
+        ++counters_.issued;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    current = texture;
+    ++counters_.issued;
+    glBindTexture(target, texture);
+}
+
+void gl_state::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (update(viewport_, std::pair{std::pair{x, y}, std::pair{width, height}}))
+        glViewport(x, y, width, height);
+}
+
+void gl_state::invalidate_bindings()
+{
+    buffers_.clear();
+    active_texture_.reset();
+    textures_.clear();
+}
+
+void gl_state::invalidate()
+{
+    invalidate_bindings();
+
+    enabled_.clear();
+    blend_func_.reset();
+    depth_func_.reset();
+    depth_mask_.reset();
+    cull_face_.reset();
+    program_.reset();
+    vertex_array_.reset();
+    viewport_.reset();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <utility>
+
+// Shadow copy of the GL state that the frame loop sets. Every setter
+// compares with the last value it passed to GL and drops the call if it
+// wouldn't change anything, which saves the driver's own validation of
+// the call; the counters tell how many calls got through and how many
+// were dropped.
+//
+// Only the calls made through the tracker are known to it. Code that
+// binds objects itself, like the texture streamer or the bone palette,
+// must be followed by invalidate_bindings(), and anything else that
+// changes the state by invalidate(); the next call then always goes
+// through to GL.
+struct gl_state
+{
+    struct counters
+    {
+        std::size_t issued = 0;
+        std::size_t filtered = 0;
+    };
+
+    void enable(GLenum capability, bool enabled = true);
+    void disable(GLenum capability) { enable(capability, false); }
+
+    void blend_func(GLenum source, GLenum destination);
+    void depth_func(GLenum function);
+    void depth_mask(bool write);
+    void cull_face(GLenum face);
+
+    void use_program(GLuint program);
+    // Also forgets the element array buffer, which belongs to the VAO
+    void bind_vertex_array(GLuint vao);
+    void bind_buffer(GLenum target, GLuint buffer);
+    // Makes the unit active, if needed, and binds the texture to it
+    void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    // Forgets the bound buffers and textures and the active texture unit
+    void invalidate_bindings();
+    // Forgets everything
+    void invalidate();
+
+    // Calls since the last reset_counters(), e.g. over the last frame
+    counters const & frame_counters() const { return counters_; }
+    void reset_counters() { counters_ = {}; }
+
+private:
+    // Returns whether the call must be issued, and remembers the new value
+    template <typename T>
+    bool update(std::optional<T> & current, T const & value);
+
+    std::map<GLenum, std::optional<bool>> enabled_;
+    std::optional<std::pair<GLenum, GLenum>> blend_func_;
+    std::optional<GLenum> depth_func_;
+    std::optional<bool> depth_mask_;
+    std::optional<GLenum> cull_face_;
+
+    std::optional<GLuint> program_;
+    std::optional<GLuint> vertex_array_;
+    std::map<GLenum, std::optional<GLuint>> buffers_;
+    std::optional<GLuint> active_texture_;
+    std::map<std::pair<GLuint, GLenum>, std::optional<GLuint>> textures_;
+
+    std::optional<std::pair<std::pair<GLint, GLint>, std::pair<GLsizei, GLsizei>>> viewport_;
+
+    counters counters_;
+};
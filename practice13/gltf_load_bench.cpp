@@ -0,0 +1,392 @@
+// Headless asset loading benchmark: loads glTF models with their textures
+// over and over and reports where the time goes, how many allocations a load
+// makes and the peak memory use, so that loader changes can be compared on
+// numbers. Besides the wolf and the bunny it loads synthetic scenes that
+// repeat every mesh, buffer and animation of the wolf many times.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <set>
+#include <string>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "gltf_loader.hpp"
+#include "texture_decoder.hpp"
+#include "thread_pool.hpp"
+
+// Every C++ allocation of the program goes through these: the loader,
+// rapidjson and the standard containers. stb_image allocates with malloc
+// and isn't counted
+static std::atomic<std::size_t> allocation_count{0};
+static std::atomic<std::size_t> allocated_bytes{0};
+
+void * operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void * result = std::malloc(size ? size : 1))
+        return result;
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+// GCC flags free() on pointers it knows came from operator new, even though
+// the operator new above got them from malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// The other forms forward to the plain one, like the array new does
+void operator delete[](void * pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+#if defined(__linux__)
+// A field of /proc/self/status given in kB, in megabytes
+static double status_field(std::string const & name)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.starts_with(name + ":"))
+            return std::stod(line.substr(name.size() + 1)) / 1024.0;
+    return 0.0;
+}
+#endif
+
+// Resident set size of the process in megabytes, 0 if unknown
+static double current_rss()
+{
+#if defined(__linux__)
+    return status_field("VmRSS");
+#else
+    return 0.0;
+#endif
+}
+
+// Starts measuring the peak RSS from the current one. Only Linux can do
+// this, elsewhere the peak stays the one of the whole process
+static bool reset_peak_rss()
+{
+#if defined(__linux__)
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5" << std::flush;
+    return static_cast<bool>(clear_refs);
+#else
+    return false;
+#endif
+}
+
+// Peak resident set size in megabytes since the start of the process or
+// the last reset_peak_rss(), 0 if unknown
+static double peak_rss()
+{
+#if defined(__linux__)
+    return status_field("VmHWM");
+#elif defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1048576.0;
+#elif defined(__unix__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#else
+    return 0.0;
+#endif
+}
+
+// Writes a glTF file that contains `copies` copies of every buffer, buffer
+// view, accessor, mesh and animation of the source. All copies refer to the
+// source buffer and image files by absolute paths, so the synthetic scene
+// reads the buffers once per copy while the images stay shared
+static std::filesystem::path make_large_scene(std::filesystem::path const & source_path, int copies)
+{
+    rapidjson::Document document;
+    {
+        std::ifstream input(source_path, std::ios::binary);
+        rapidjson::IStreamWrapper stream(input);
+        document.ParseStream(stream);
+    }
+
+    auto & allocator = document.GetAllocator();
+    auto const directory = std::filesystem::absolute(source_path).parent_path();
+
+    auto make_absolute = [&](rapidjson::Value & object)
+    {
+        if (object.HasMember("uri"))
+            object["uri"].SetString((directory / object["uri"].GetString()).string().c_str(), allocator);
+    };
+
+    for (auto & image : document["images"].GetArray())
+        make_absolute(image);
+    for (auto & buffer : document["buffers"].GetArray())
+        make_absolute(buffer);
+
+    // Adds `offset` to an index member, if there is one
+    auto shift = [](rapidjson::Value & object, char const * name, unsigned int offset)
+    {
+        if (object.IsObject() && object.HasMember(name))
+            object[name].SetUint(object[name].GetUint() + offset);
+    };
+
+    auto replicate = [&](char const * array_name, auto && remap)
+    {
+        if (!document.HasMember(array_name))
+            return 0u;
+
+        auto & array = document[array_name];
+        unsigned int const size = array.Size();
+
+        for (int copy = 1; copy < copies; ++copy)
+        {
+            for (unsigned int i = 0; i < size; ++i)
+            {
+                rapidjson::Value element(array[i], allocator);
+                remap(element, copy);
+                array.PushBack(element, allocator);
+            }
+        }
+
+        return size;
+    };
+
+    unsigned int const buffer_count = document["buffers"].Size();
+    unsigned int const view_count = document["bufferViews"].Size();
+    unsigned int const accessor_count = document["accessors"].Size();
+
+    replicate("buffers", [](rapidjson::Value &, int){});
+
+    replicate("bufferViews", [&](rapidjson::Value & view, int copy)
+    {
+        shift(view, "buffer", copy * buffer_count);
+        if (view.HasMember("extensions") && view["extensions"].HasMember("EXT_meshopt_compression"))
+            shift(view["extensions"]["EXT_meshopt_compression"], "buffer", copy * buffer_count);
+    });
+
+    replicate("accessors", [&](rapidjson::Value & accessor, int copy)
+    {
+        shift(accessor, "bufferView", copy * view_count);
+        if (accessor.HasMember("sparse"))
+        {
+            shift(accessor["sparse"]["indices"], "bufferView", copy * view_count);
+            shift(accessor["sparse"]["values"], "bufferView", copy * view_count);
+        }
+    });
+
+    replicate("meshes", [&](rapidjson::Value & mesh, int copy)
+    {
+        for (auto & primitive : mesh["primitives"].GetArray())
+        {
+            shift(primitive, "indices", copy * accessor_count);
+            for (auto & attribute : primitive["attributes"].GetObject())
+                attribute.value.SetUint(attribute.value.GetUint() + copy * accessor_count);
+            if (primitive.HasMember("targets"))
+                for (auto & target : primitive["targets"].GetArray())
+                    for (auto & attribute : target.GetObject())
+                        attribute.value.SetUint(attribute.value.GetUint() + copy * accessor_count);
+        }
+    });
+
+    replicate("animations", [&](rapidjson::Value & animation, int copy)
+    {
+        std::string const name = animation["name"].GetString() + std::string(" ") + std::to_string(copy);
+        animation["name"].SetString(name.c_str(), allocator);
+        for (auto & sampler : animation["samplers"].GetArray())
+        {
+            shift(sampler, "input", copy * accessor_count);
+            shift(sampler, "output", copy * accessor_count);
+        }
+    });
+
+    auto const path = std::filesystem::temp_directory_path() / ("gltf_load_bench_" + std::to_string(copies) + ".gltf");
+    std::ofstream output(path);
+    rapidjson::OStreamWrapper stream(output);
+    rapidjson::Writer<rapidjson::OStreamWrapper> writer(stream);
+    document.Accept(writer);
+
+    return path;
+}
+
+// Per-load averages of a model
+struct load_result
+{
+    gltf_load_stats stages;
+    double images = 0.0;
+    double total = 0.0;
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+    // Textures referenced by the model but missing on disk, these are skipped
+    std::vector<std::filesystem::path> missing_images;
+};
+
+static load_result measure_load(std::filesystem::path const & path, thread_pool & pool)
+{
+    load_result result;
+
+    // Run for at least a second, but at least a few times
+    int iterations = 0;
+    std::chrono::duration<double> elapsed{0.0};
+    while (elapsed.count() < 1.0 || iterations < 3)
+    {
+        std::size_t const allocations_before = allocation_count.load();
+        std::size_t const bytes_before = allocated_bytes.load();
+        auto const start = std::chrono::high_resolution_clock::now();
+
+        auto const model = load_gltf(path, &result.stages);
+
+        // Images are decoded the way the application does it, on the pool
+        auto const images_start = std::chrono::high_resolution_clock::now();
+        {
+            texture_decoder decoder(pool);
+            std::set<std::string> texture_paths;
+            for (auto const & mesh : model.meshes)
+            {
+                if (!mesh.material.texture_path || !texture_paths.insert(*mesh.material.texture_path).second) continue;
+
+                auto const image_path = path.parent_path() / *mesh.material.texture_path;
+                if (!std::filesystem::exists(image_path))
+                {
+                    if (iterations == 0)
+                        result.missing_images.push_back(image_path);
+                    continue;
+                }
+
+                decoder.submit(*mesh.material.texture_path, image_path);
+            }
+            while (decoder.pop());
+        }
+
+        auto const end = std::chrono::high_resolution_clock::now();
+
+        result.images += std::chrono::duration<double>(end - images_start).count();
+        result.total += std::chrono::duration<double>(end - start).count();
+        result.allocations += allocation_count.load() - allocations_before;
+        result.bytes += allocated_bytes.load() - bytes_before;
+
+        ++iterations;
+        elapsed += end - start;
+    }
+
+    result.stages.parse /= iterations;
+    result.stages.buffers /= iterations;
+    result.stages.meshes /= iterations;
+    result.stages.animations /= iterations;
+    result.images /= iterations;
+    result.total /= iterations;
+    result.allocations /= iterations;
+    result.bytes /= iterations;
+    return result;
+}
+
+int main(int argc, char ** argv) try
+{
+    const std::string project_root = PROJECT_ROOT;
+    std::filesystem::path const wolf_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+
+    // The bunny lives next door, in practice14; models given on the command
+    // line are loaded instead of the default set
+    std::vector<std::pair<std::string, std::filesystem::path>> models;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+            models.emplace_back(std::filesystem::path(argv[i]).filename().string(), argv[i]);
+    }
+    else
+    {
+        models.emplace_back("wolf", wolf_path);
+        models.emplace_back("bunny", project_root + "/../practice14/bunny/bunny.gltf");
+        for (int copies : {8, 64})
+            models.emplace_back("wolf x" + std::to_string(copies), make_large_scene(wolf_path, copies));
+    }
+
+    thread_pool pool;
+
+    // Each model's peak is measured from the RSS it starts with when the
+    // peak can be reset, otherwise the column is the running process peak
+    bool const per_model_peak = reset_peak_rss();
+
+    std::cout << "Times are per load in milliseconds, threads: " << pool.size() << std::endl;
+    std::cout << std::left << std::setw(14) << "model"
+        << std::setw(10) << "parse"
+        << std::setw(10) << "buffers"
+        << std::setw(10) << "meshes"
+        << std::setw(12) << "animations"
+        << std::setw(10) << "images"
+        << std::setw(10) << "total"
+        << std::setw(14) << "allocations"
+        << std::setw(16) << "allocated, MB"
+        << (per_model_peak ? "peak RSS growth, MB" : "process peak RSS, MB") << std::endl;
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    for (auto const & [name, path] : models)
+    {
+        if (per_model_peak)
+            reset_peak_rss();
+        double const baseline_rss = per_model_peak ? current_rss() : 0.0;
+
+        auto const result = measure_load(path, pool);
+
+        std::cout << std::left << std::setw(14) << name
+            << std::setw(10) << result.stages.parse * 1e3
+            << std::setw(10) << result.stages.buffers * 1e3
+            << std::setw(10) << result.stages.meshes * 1e3
+            << std::setw(12) << result.stages.animations * 1e3
+            << std::setw(10) << result.images * 1e3
+            << std::setw(10) << result.total * 1e3
+            << std::setw(14) << result.allocations
+            << std::setw(16) << result.bytes / 1048576.0
+            << peak_rss() - baseline_rss << std::endl;
+
+        for (auto const & image : result.missing_images)
+            std::cout << "    missing image skipped: " << image.string() << std::endl;
+    }
+
+    if (argc <= 1)
+        for (int copies : {8, 64})
+            std::filesystem::remove(std::filesystem::temp_directory_path() / ("gltf_load_bench_" + std::to_string(copies) + ".gltf"));
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -1,8 +1,12 @@
 #include "gltf_loader.hpp"
+#include "meshopt_decoder.hpp"
 
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
 
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 
@@ -12,12 +16,299 @@ static unsigned int attribute_type_to_size(std::string const & type)
     if (type == "VEC2") return 2;
     if (type == "VEC3") return 3;
     if (type == "VEC4") return 4;
-    return 0;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
     throw std::runtime_error("Unknown attribute type: " + type);
 }
 
-gltf_model load_gltf(std::filesystem::path const & path)
+static std::size_t component_size(unsigned int type)
 {
+    if (type != 0x1406 && (type < 0x1400 || type > 0x1403))
+        throw std::runtime_error("Unsupported accessor component type: " + std::to_string(type));
+
+    switch (type)
+    {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    default: // GL_FLOAT
+        return 4;
+    }
+}
+
+// Reads `count` elements of `components` floats from data with the given
+// component type, see read_float_accessor
+static void read_floats(char const * data, unsigned int type, bool normalized, std::size_t stride, std::size_t count, std::size_t components, float * result)
+{
+    // Also rejects the unsupported types
+    std::size_t const size = component_size(type);
+    if (stride == 0)
+        stride = components * size;
+
+    if (type == 0x1406 && stride == components * sizeof(float))
+    {
+        std::memcpy(result, data, count * stride);
+        return;
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto const element = data + i * stride;
+        auto const values = result + i * components;
+
+        for (std::size_t c = 0; c < components; ++c)
+        {
+            // Integers that aren't normalized are taken as they are, like
+            // glVertexAttribPointer does with normalized = GL_FALSE
+            switch (type)
+            {
+            case 0x1400: // GL_BYTE
+                values[c] = reinterpret_cast<std::int8_t const *>(element)[c];
+                if (normalized)
+                    values[c] = std::max(values[c] / 127.f, -1.f);
+                break;
+            case 0x1401: // GL_UNSIGNED_BYTE
+                values[c] = reinterpret_cast<std::uint8_t const *>(element)[c];
+                if (normalized)
+                    values[c] /= 255.f;
+                break;
+            case 0x1402: // GL_SHORT
+                values[c] = reinterpret_cast<std::int16_t const *>(element)[c];
+                if (normalized)
+                    values[c] = std::max(values[c] / 32767.f, -1.f);
+                break;
+            case 0x1403: // GL_UNSIGNED_SHORT
+                values[c] = reinterpret_cast<std::uint16_t const *>(element)[c];
+                if (normalized)
+                    values[c] /= 65535.f;
+                break;
+            default: // GL_FLOAT
+                std::memcpy(&values[c], element + c * sizeof(float), sizeof(float));
+                break;
+            }
+        }
+    }
+}
+
+// The elements must lie within the buffer, whatever the accessor claims
+static void check_bounds(gltf_model const & model, gltf_model::accessor const & accessor, std::size_t element_size)
+{
+    if (accessor.count == 0)
+        return;
+
+    std::size_t const stride = accessor.view.stride ? accessor.view.stride : element_size;
+    if (accessor.view.offset + (accessor.count - 1) * stride + element_size > model.buffer.size())
+        throw std::runtime_error("Accessor data is out of the buffer bounds");
+}
+
+void read_float_accessor(gltf_model const & model, gltf_model::accessor const & accessor, std::size_t components, float * result)
+{
+    if (accessor.size != components)
+        throw std::runtime_error("Unexpected accessor size: " + std::to_string(accessor.size) + " instead of " + std::to_string(components));
+
+    check_bounds(model, accessor, components * component_size(accessor.type));
+    read_floats(model.buffer.data() + accessor.view.offset, accessor.type, accessor.normalized, accessor.view.stride, accessor.count, components, result);
+}
+
+std::vector<std::uint16_t> read_joint_accessor(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    if (accessor.type != 0x1401 && accessor.type != 0x1403) // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT
+        throw std::runtime_error("Unsupported joint component type: " + std::to_string(accessor.type));
+    if (accessor.size != 4)
+        throw std::runtime_error("Joint accessors must have four components");
+
+    std::size_t const size = component_size(accessor.type);
+    std::size_t const stride = accessor.view.stride ? accessor.view.stride : 4 * size;
+    check_bounds(model, accessor, 4 * size);
+
+    std::vector<std::uint16_t> result(4 * accessor.count);
+    for (std::size_t i = 0; i < accessor.count; ++i)
+    {
+        auto const element = model.buffer.data() + accessor.view.offset + i * stride;
+        for (std::size_t c = 0; c < 4; ++c)
+        {
+            if (size == 1)
+                result[4 * i + c] = reinterpret_cast<std::uint8_t const *>(element)[c];
+            else
+                result[4 * i + c] = reinterpret_cast<std::uint16_t const *>(element)[c];
+        }
+    }
+    return result;
+}
+
+bool is_packed_float_accessor(gltf_model::accessor const & accessor, std::size_t components)
+{
+    return accessor.type == 0x1406 && accessor.size == components
+        && (accessor.view.stride == 0 || accessor.view.stride == components * sizeof(float));
+}
+
+// Keeps only the vertices that the target moves, as runs of consecutive
+// vertices; short gaps are merged into the runs so that they stay long
+// enough to be applied with SIMD
+static gltf_model::morph_target compact_morph_target(std::vector<glm::vec3> const & positions, std::vector<glm::vec3> const & normals)
+{
+    static constexpr std::size_t max_gap = 4;
+
+    auto moved = [&](std::size_t i)
+    {
+        return positions[i] != glm::vec3(0.f) || (!normals.empty() && normals[i] != glm::vec3(0.f));
+    };
+
+    gltf_model::morph_target result;
+
+    for (std::size_t i = 0; i < positions.size();)
+    {
+        if (!moved(i))
+        {
+            ++i;
+            continue;
+        }
+
+        std::size_t last_moved = i;
+        for (std::size_t j = i + 1; j < positions.size() && j - last_moved <= max_gap; ++j)
+            if (moved(j))
+                last_moved = j;
+
+        std::size_t const end = last_moved + 1;
+
+        result.runs.push_back({
+            static_cast<unsigned int>(i),
+            static_cast<unsigned int>(end - i),
+            static_cast<unsigned int>(result.position_deltas.size()),
+        });
+        result.position_deltas.insert(result.position_deltas.end(), positions.begin() + i, positions.begin() + end);
+        if (!normals.empty())
+            result.normal_deltas.insert(result.normal_deltas.end(), normals.begin() + i, normals.begin() + end);
+
+        i = end;
+    }
+
+    return result;
+}
+
+static std::vector<char> read_buffer(rapidjson::Value const & buffer, std::filesystem::path const & directory)
+{
+    if (!buffer.HasMember("uri"))
+        throw std::runtime_error("glTF buffer without uri is referenced");
+
+    auto const buffer_path = directory / buffer["uri"].GetString();
+
+    std::vector<char> result(std::filesystem::file_size(buffer_path));
+    std::ifstream input(buffer_path, std::ios::binary);
+    input.read(result.data(), result.size());
+    return result;
+}
+
+// Appends the data of all buffer views to the model buffer and returns
+// where each view ended up. Views compressed with EXT_meshopt_compression
+// are decoded, and buffers that are only referenced by compressed views
+// (the compressed data itself) aren't kept in the model buffer
+static std::vector<gltf_model::buffer_view> load_buffer_views(rapidjson::Document const & document, std::filesystem::path const & directory, std::vector<char> & buffer)
+{
+    auto const buffers = document["buffers"].GetArray();
+    auto const views = document["bufferViews"].GetArray();
+
+    auto meshopt_extension = [](rapidjson::Value const & view) -> rapidjson::Value const *
+    {
+        if (!view.HasMember("extensions") || !view["extensions"].HasMember("EXT_meshopt_compression"))
+            return nullptr;
+        return &view["extensions"]["EXT_meshopt_compression"];
+    };
+
+    auto align = [&]
+    {
+        buffer.resize((buffer.size() + 15) & ~std::size_t(15));
+    };
+
+    std::vector<std::optional<std::size_t>> buffer_offsets(buffers.Size());
+    for (auto const & view : views)
+    {
+        if (meshopt_extension(view)) continue;
+
+        unsigned int const index = view["buffer"].GetUint();
+        if (buffer_offsets[index]) continue;
+
+        align();
+        buffer_offsets[index] = buffer.size();
+
+        auto const data = read_buffer(buffers[index], directory);
+        buffer.insert(buffer.end(), data.begin(), data.end());
+    }
+
+    std::vector<std::optional<std::vector<char>>> compressed_buffers(buffers.Size());
+
+    std::vector<gltf_model::buffer_view> result;
+    for (auto const & view : views)
+    {
+        unsigned int const stride = view.HasMember("byteStride") ? view["byteStride"].GetUint() : 0;
+
+        auto const extension = meshopt_extension(view);
+        if (!extension)
+        {
+            unsigned int const offset = view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0;
+            result.push_back({static_cast<unsigned int>(*buffer_offsets[view["buffer"].GetUint()] + offset), view["byteLength"].GetUint(), stride});
+            continue;
+        }
+
+        auto const & compression = *extension;
+
+        unsigned int const source_index = compression["buffer"].GetUint();
+        if (!compressed_buffers[source_index])
+            compressed_buffers[source_index] = read_buffer(buffers[source_index], directory);
+
+        auto const source = reinterpret_cast<unsigned char const *>(compressed_buffers[source_index]->data())
+            + (compression.HasMember("byteOffset") ? compression["byteOffset"].GetUint() : 0);
+        std::size_t const source_size = compression["byteLength"].GetUint();
+
+        std::size_t const count = compression["count"].GetUint();
+        std::size_t const element_size = compression["byteStride"].GetUint();
+
+        align();
+        std::size_t const offset = buffer.size();
+        buffer.resize(offset + count * element_size);
+        auto const destination = buffer.data() + offset;
+
+        std::string const mode = compression["mode"].GetString();
+        if (mode == "ATTRIBUTES")
+            meshopt_decode_vertex_buffer(destination, count, element_size, source, source_size);
+        else if (mode == "TRIANGLES")
+            meshopt_decode_index_buffer(destination, count, element_size, source, source_size);
+        else if (mode == "INDICES")
+            meshopt_decode_index_sequence(destination, count, element_size, source, source_size);
+        else
+            throw std::runtime_error("Unknown meshopt compression mode: " + mode);
+
+        std::string const filter = compression.HasMember("filter") ? compression["filter"].GetString() : "NONE";
+        if (filter == "OCTAHEDRAL")
+            meshopt_decode_filter_oct(destination, count, element_size);
+        else if (filter == "QUATERNION")
+            meshopt_decode_filter_quat(destination, count, element_size);
+        else if (filter == "EXPONENTIAL")
+            meshopt_decode_filter_exp(destination, count, element_size);
+        else if (filter != "NONE")
+            throw std::runtime_error("Unknown meshopt filter: " + filter);
+
+        result.push_back({static_cast<unsigned int>(offset), static_cast<unsigned int>(count * element_size), stride});
+    }
+
+    return result;
+}
+
+gltf_model load_gltf(std::filesystem::path const & path, gltf_load_stats * stats)
+{
+    auto stage_start = std::chrono::steady_clock::now();
+    auto end_stage = [&](double gltf_load_stats::* stage)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        if (stats)
+            stats->*stage += std::chrono::duration<double>(now - stage_start).count();
+        stage_start = now;
+    };
+
     rapidjson::Document document;
 
     {
@@ -26,35 +317,43 @@ gltf_model load_gltf(std::filesystem::path const & path)
         document.ParseStream(stream);
     }
 
-    gltf_model result;
-
+    if (document.HasMember("extensionsRequired"))
     {
-        auto buffers = document["buffers"].GetArray();
-        assert(buffers.Size() == 1);
+        for (auto const & extension : document["extensionsRequired"].GetArray())
+        {
+            std::string const name = extension.GetString();
+            if (name != "KHR_mesh_quantization" && name != "EXT_meshopt_compression")
+                throw std::runtime_error("Unsupported glTF extension: " + name);
+        }
+    }
 
-        auto const buffer_uri = buffers[0]["uri"].GetString();
+    end_stage(&gltf_load_stats::parse);
 
-        auto const buffer_path = path.parent_path() / buffer_uri;
+    gltf_model result;
 
-        result.buffer.resize(std::filesystem::file_size(buffer_path));
-        std::ifstream buffer(buffer_path, std::ios::binary);
-        buffer.read(result.buffer.data(), result.buffer.size());
-    }
+    std::vector<gltf_model::buffer_view> buffer_views = load_buffer_views(document, path.parent_path(), result.buffer);
+
+    end_stage(&gltf_load_stats::buffers);
 
     auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
     {
-        auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
+        return buffer_views.at(index);
     };
 
     auto parse_accessor = [&](int index) -> gltf_model::accessor
     {
         auto accessor = document["accessors"].GetArray()[index].GetObject();
+
+        auto view = parse_buffer_view(accessor["bufferView"].GetInt());
+        if (accessor.HasMember("byteOffset"))
+            view.offset += accessor["byteOffset"].GetUint();
+
         return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
+            view,
             accessor["componentType"].GetUint(),
             attribute_type_to_size(accessor["type"].GetString()),
             accessor["count"].GetUint(),
+            accessor.HasMember("normalized") && accessor["normalized"].GetBool(),
         };
     };
 
@@ -74,6 +373,60 @@ gltf_model load_gltf(std::filesystem::path const & path)
         };
     };
 
+    // Reads a VEC3 accessor that may have no buffer view (meaning all
+    // zeros) and may be sparse, as morph target accessors usually are
+    auto read_vec3_accessor = [&](int index)
+    {
+        auto const & accessor = document["accessors"].GetArray()[index];
+        auto const component_type = accessor["componentType"].GetUint();
+        bool const normalized = accessor.HasMember("normalized") && accessor["normalized"].GetBool();
+
+        auto data_offset = [&](auto const & object)
+        {
+            unsigned int offset = parse_buffer_view(object["bufferView"].GetInt()).offset;
+            if (object.HasMember("byteOffset"))
+                offset += object["byteOffset"].GetUint();
+            return offset;
+        };
+
+        std::vector<glm::vec3> values(accessor["count"].GetUint(), glm::vec3(0.f));
+
+        if (accessor.HasMember("bufferView"))
+            read_float_accessor(result, parse_accessor(index), 3, reinterpret_cast<float *>(values.data()));
+
+        if (accessor.HasMember("sparse"))
+        {
+            auto const & sparse = accessor["sparse"];
+            auto const & indices = sparse["indices"];
+
+            auto const index_type = indices["componentType"].GetUint();
+            auto const index_data = result.buffer.data() + data_offset(indices);
+            // Sparse values are tightly packed and of the accessor's own type
+            std::vector<glm::vec3> sparse_values(sparse["count"].GetUint());
+            std::size_t const value_offset = data_offset(sparse["values"]);
+            if (value_offset + sparse_values.size() * 3 * component_size(component_type) > result.buffer.size())
+                throw std::runtime_error("Sparse accessor data is out of the buffer bounds");
+            read_floats(result.buffer.data() + value_offset, component_type, normalized, 0, sparse_values.size(), 3, reinterpret_cast<float *>(sparse_values.data()));
+
+            for (unsigned int i = 0; i < sparse["count"].GetUint(); ++i)
+            {
+                unsigned int vertex;
+                if (index_type == 0x1401) // GL_UNSIGNED_BYTE
+                    vertex = reinterpret_cast<std::uint8_t const *>(index_data)[i];
+                else if (index_type == 0x1403) // GL_UNSIGNED_SHORT
+                    vertex = reinterpret_cast<std::uint16_t const *>(index_data)[i];
+                else
+                    vertex = reinterpret_cast<std::uint32_t const *>(index_data)[i];
+
+                if (vertex >= values.size())
+                    throw std::runtime_error("Sparse accessor index is out of range");
+                values[vertex] = sparse_values[i];
+            }
+        }
+
+        return values;
+    };
+
     for (auto const & mesh : document["meshes"].GetArray())
     {
         auto & result_mesh = result.meshes.emplace_back();
@@ -88,8 +441,32 @@ gltf_model load_gltf(std::filesystem::path const & path)
         result_mesh.position = parse_accessor(attributes["POSITION"].GetInt());
         result_mesh.normal = parse_accessor(attributes["NORMAL"].GetInt());
         result_mesh.texcoord = parse_accessor(attributes["TEXCOORD_0"].GetInt());
-        result_mesh.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
-        result_mesh.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
+        if (attributes.HasMember("JOINTS_0"))
+        {
+            result_mesh.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
+            result_mesh.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
+        }
+
+        if (primitives[0].HasMember("targets"))
+        {
+            for (auto const & target : primitives[0]["targets"].GetArray())
+            {
+                auto const positions = read_vec3_accessor(target["POSITION"].GetInt());
+                std::vector<glm::vec3> normals;
+                if (target.HasMember("NORMAL"))
+                    normals = read_vec3_accessor(target["NORMAL"].GetInt());
+
+                result_mesh.targets.push_back(compact_morph_target(positions, normals));
+            }
+
+            result_mesh.target_weights.assign(result_mesh.targets.size(), 0.f);
+            if (mesh.HasMember("weights"))
+            {
+                auto weights = mesh["weights"].GetArray();
+                for (unsigned int i = 0; i < weights.Size() && i < result_mesh.targets.size(); ++i)
+                    result_mesh.target_weights[i] = weights[i].GetFloat();
+            }
+        }
 
         auto const & material = document["materials"].GetArray()[primitives[0]["material"].GetInt()];
 
@@ -103,16 +480,18 @@ gltf_model load_gltf(std::filesystem::path const & path)
             result_mesh.material.color = parse_color(pbr["baseColorFactor"].GetArray());
     }
 
-    auto skins = document["skins"].GetArray();
-    assert(skins.Size() == 1);
+    end_stage(&gltf_load_stats::meshes);
 
+    // Static models have no skeleton and no animations
+    if (document.HasMember("skins"))
     {
+        auto skins = document["skins"].GetArray();
+        assert(skins.Size() == 1);
+
         auto fill_buffer = [&](auto & vector, gltf_model::accessor const & accessor)
         {
-            assert(accessor.type == 0x1406); // GL_FLOAT
             using value_type = std::decay_t<decltype(vector[0])>;
-            auto begin = reinterpret_cast<value_type const *>(result.buffer.data() + accessor.view.offset);
-            vector.assign(begin, begin + accessor.count);
+            vector = read_float_accessor<value_type>(result, accessor);
         };
 
         auto fix_rotations = [](std::vector<glm::quat> & rotations)
@@ -170,9 +549,6 @@ gltf_model load_gltf(std::filesystem::path const & path)
             for (auto const & channel : animation["channels"].GetArray())
             {
                 int node_id = channel["target"]["node"].GetInt();
-                if (!bone_node_to_index.contains(node_id)) continue;
-
-                auto & bone = result_animation.bones[bone_node_to_index.at(node_id)];
 
                 std::string path = channel["target"]["path"].GetString();
 
@@ -181,6 +557,21 @@ gltf_model load_gltf(std::filesystem::path const & path)
                 auto input = parse_accessor(sampler["input"].GetInt());
                 auto output = parse_accessor(sampler["output"].GetInt());
 
+                if (path == "weights")
+                {
+                    if (!nodes[node_id].HasMember("mesh")) continue;
+
+                    auto & morph_weights = result_animation.morph_weights.emplace_back();
+                    morph_weights.mesh = nodes[node_id]["mesh"].GetUint();
+                    fill_buffer(morph_weights.timestamps, input);
+                    fill_buffer(morph_weights.values, output);
+                    continue;
+                }
+
+                if (!bone_node_to_index.contains(node_id)) continue;
+
+                auto & bone = result_animation.bones[bone_node_to_index.at(node_id)];
+
                 if (path == "translation")
                 {
                     fill_buffer(bone.translation.timestamps, input);
@@ -212,9 +603,14 @@ gltf_model load_gltf(std::filesystem::path const & path)
                 update_max_time(bone.scale.timestamps);
             }
 
+            for (auto const & morph_weights : result_animation.morph_weights)
+                update_max_time(morph_weights.timestamps);
+
             result.animations[std::move(name)] = std::move(result_animation);
         }
     }
 
+    end_stage(&gltf_load_stats::animations);
+
     return result;
 }
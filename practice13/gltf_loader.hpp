@@ -6,9 +6,15 @@
 #include <optional>
 #include <unordered_map>
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
 
+#ifndef GLM_FORCE_SWIZZLE
 #define GLM_FORCE_SWIZZLE
+#endif
+#ifndef GLM_ENABLE_EXPERIMENTAL
 #define GLM_ENABLE_EXPERIMENTAL
+#endif
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -20,14 +26,19 @@ struct gltf_model
     {
         unsigned int offset;
         unsigned int size;
+        // 0 for tightly packed data
+        unsigned int stride = 0;
     };
 
     struct accessor
     {
+        // The view offset includes the accessor's own offset
         buffer_view view;
         unsigned int type;
         unsigned int size;
         unsigned int count;
+        // Integer data mapped to [0, 1] or [-1, 1], see KHR_mesh_quantization
+        bool normalized = false;
     };
 
     struct material
@@ -54,6 +65,32 @@ struct gltf_model
         T operator()(float time) const;
     };
 
+    struct morph_target
+    {
+        // A run of consecutive vertices moved by the target, vertices that
+        // the target doesn't move aren't stored at all
+        struct run
+        {
+            unsigned int first_vertex;
+            unsigned int vertex_count;
+            // Index of the first delta of the run
+            unsigned int delta_offset;
+        };
+
+        std::vector<run> runs;
+        std::vector<glm::vec3> position_deltas;
+        // Empty if the target doesn't move normals
+        std::vector<glm::vec3> normal_deltas;
+    };
+
+    struct morph_weights_animation
+    {
+        unsigned int mesh;
+        std::vector<float> timestamps;
+        // One weight per target for every timestamp
+        std::vector<float> values;
+    };
+
     struct bone_animation
     {
         spline<glm::vec3> translation;
@@ -64,6 +101,7 @@ struct gltf_model
     struct animation
     {
         std::vector<bone_animation> bones;
+        std::vector<morph_weights_animation> morph_weights;
         float max_time = 0.f;
     };
 
@@ -77,8 +115,13 @@ struct gltf_model
         accessor position;
         accessor normal;
         accessor texcoord;
-        accessor joints;
-        accessor weights;
+        // Empty (count == 0) for meshes without a skin
+        accessor joints{};
+        accessor weights{};
+
+        std::vector<morph_target> targets;
+        // Default target weights
+        std::vector<float> target_weights;
     };
 
     std::vector<char> buffer;
@@ -87,7 +130,44 @@ struct gltf_model
     std::unordered_map<std::string, animation> animations;
 };
 
-gltf_model load_gltf(std::filesystem::path const & path);
+// Time spent in the stages of load_gltf, in seconds; accumulated, so that
+// one instance can collect the totals of many loads
+struct gltf_load_stats
+{
+    // Reading and parsing the JSON
+    double parse = 0.0;
+    // Reading the buffers and decompressing their views
+    double buffers = 0.0;
+    // Meshes with their accessors, materials and morph targets
+    double meshes = 0.0;
+    // Skeleton and animation channels
+    double animations = 0.0;
+};
+
+gltf_model load_gltf(std::filesystem::path const & path, gltf_load_stats * stats = nullptr);
+
+// Reads the elements of a vertex or animation accessor as floats, with
+// `components` floats per element. Float data is copied and integers
+// (KHR_mesh_quantization) are converted, and dequantized if normalized,
+// following the stride of the buffer view. Accessors of another size or
+// outside of the buffer throw std::runtime_error
+void read_float_accessor(gltf_model const & model, gltf_model::accessor const & accessor, std::size_t components, float * result);
+
+template <typename T>
+std::vector<T> read_float_accessor(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    std::vector<T> result(accessor.count);
+    read_float_accessor(model, accessor, sizeof(T) / sizeof(float), reinterpret_cast<float *>(result.data()));
+    return result;
+}
+
+// Reads a JOINTS accessor of unsigned bytes or shorts as four indices per
+// vertex, following the stride of the buffer view
+std::vector<std::uint16_t> read_joint_accessor(gltf_model const & model, gltf_model::accessor const & accessor);
+
+// Whether the accessor is tightly packed floats, `components` per element,
+// that can be used in place
+bool is_packed_float_accessor(gltf_model::accessor const & accessor, std::size_t components);
 
 template <>
 inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
@@ -15,7 +15,11 @@
 #include <vector>
 #include <random>
 #include <map>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <limits>
+#include <optional>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -28,7 +32,19 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
-#include "stb_image.h"
+#include "animation.hpp"
+#include "bone_palette.hpp"
+#include "crowd.hpp"
+#include "vertex_animation_texture.hpp"
+#include "morph.hpp"
+#include "animated_bounds.hpp"
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+#include "texture_streamer.hpp"
+#include "cpu_skinning.hpp"
+#include "render_queue.hpp"
+#include "gl_state.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -46,23 +62,125 @@ void glew_fail(std::string_view message, GLenum error)
 }
 
 const char vertex_shader_source[] =
-R"(#version 330 core
+R"(
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform int palette_offset;
+uniform int palette_stride;
+
+#ifdef BONE_PALETTE_TEXTURE_BUFFER
+uniform samplerBuffer bone_palette;
+
+mat3x4 get_bone(int index)
+{
+    int texel = 3 * (palette_offset + gl_InstanceID * palette_stride + index);
+    return mat3x4(
+        texelFetch(bone_palette, texel + 0),
+        texelFetch(bone_palette, texel + 1),
+        texelFetch(bone_palette, texel + 2)
+    );
+}
+#else
+layout (std140) uniform BonePalette
+{
+    mat3x4 bones[BONE_PALETTE_SIZE];
+};
+
+mat3x4 get_bone(int index)
+{
+    return bones[palette_offset + gl_InstanceID * palette_stride + index];
+}
+#endif
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in ivec4 in_joints;
+layout (location = 4) in vec4 in_weights;
+layout (location = 5) in mat4 in_model;
+
+out vec3 normal;
+out vec2 texcoord;
+
+void main()
+{
+    mat3x4 bone_transform = in_weights.x * get_bone(in_joints.x)
+        + in_weights.y * get_bone(in_joints.y)
+        + in_weights.z * get_bone(in_joints.z)
+        + in_weights.w * get_bone(in_joints.w);
+
+    vec3 position = vec4(in_position, 1.0) * bone_transform;
 
-uniform mat4 model;
+    gl_Position = projection * view * in_model * vec4(position, 1.0);
+    normal = mat3(in_model) * (vec4(in_normal, 0.0) * bone_transform);
+    texcoord = in_texcoord;
+}
+)";
+
+const char vat_vertex_shader_source[] =
+R"(
 uniform mat4 view;
 uniform mat4 projection;
 
+uniform sampler2D animation_texture;
+uniform int texels_per_frame;
+uniform float frame_rate;
+uniform float time;
+
+// First frame and frame count of every clip
+uniform ivec2 clips[MAX_CLIPS];
+
+#ifdef VAT_VERTICES
+uniform int vertex_offset;
+#endif
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in ivec4 in_joints;
+layout (location = 4) in vec4 in_weights;
+layout (location = 5) in mat4 in_model;
+layout (location = 9) in vec2 in_animation;
 
 out vec3 normal;
 out vec2 texcoord;
 
+vec4 fetch(int frame, int texel)
+{
+    int index = frame * texels_per_frame + texel;
+    int width = textureSize(animation_texture, 0).x;
+    return texelFetch(animation_texture, ivec2(index % width, index / width), 0);
+}
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(in_position, 1.0);
-    normal = mat3(model) * in_normal;
+    ivec2 clip = clips[int(in_animation.x)];
+    float frame = mod(time + in_animation.y, float(clip.y) / frame_rate) * frame_rate;
+    int frame0 = clip.x + int(frame);
+    int frame1 = clip.x + (int(frame) + 1) % clip.y;
+    float t = fract(frame);
+
+#ifdef VAT_VERTICES
+    int texel = 2 * (vertex_offset + gl_VertexID);
+    vec3 position = mix(fetch(frame0, texel).xyz, fetch(frame1, texel).xyz, t);
+    vec3 skinned_normal = mix(fetch(frame0, texel + 1).xyz, fetch(frame1, texel + 1).xyz, t);
+#else
+    mat3x4 bone_transform = mat3x4(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+        int texel = 3 * in_joints[i];
+        mat3x4 bone0 = mat3x4(fetch(frame0, texel), fetch(frame0, texel + 1), fetch(frame0, texel + 2));
+        mat3x4 bone1 = mat3x4(fetch(frame1, texel), fetch(frame1, texel + 1), fetch(frame1, texel + 2));
+        bone_transform += in_weights[i] * (bone0 * (1.0 - t) + bone1 * t);
+    }
+
+    vec3 position = vec4(in_position, 1.0) * bone_transform;
+    vec3 skinned_normal = vec4(in_normal, 0.0) * bone_transform;
+#endif
+
+    gl_Position = projection * view * in_model * vec4(position, 1.0);
+    normal = mat3(in_model) * skinned_normal;
     texcoord = in_texcoord;
 }
 )";
@@ -174,22 +292,127 @@ int main() try
     if (!GLEW_VERSION_3_3)
         throw std::runtime_error("OpenGL 3.3 is not supported");
 
-    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+
+    auto const input_model = load_gltf(model_path);
+
+    // Textures stream in while the application is already rendering, with
+    // a grey placeholder until they are uploaded
+    thread_pool pool;
+    texture_streamer textures(pool);
+    std::map<std::string, texture_streamer::handle> texture_handles;
+    for (auto const & mesh : input_model.meshes)
+        if (mesh.material.texture_path && !texture_handles.contains(*mesh.material.texture_path))
+            texture_handles[*mesh.material.texture_path] = textures.request(std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path);
+
+    std::vector<std::string> animation_names;
+    for (auto const & [name, animation] : input_model.animations)
+        animation_names.push_back(name);
+    std::sort(animation_names.begin(), animation_names.end());
+
+    // A pack of wolves, each playing one of a few animation phases, so that
+    // many of them share their poses
+    crowd wolves(input_model, animation_names);
+    {
+        int const crowd_size = 16;
+
+        std::default_random_engine rng;
+        std::uniform_int_distribution<std::size_t> animation_distribution(0, animation_names.size() - 1);
+        std::uniform_int_distribution<int> phase_distribution(0, 3);
+
+        for (int x = 0; x < crowd_size; ++x)
+        {
+            for (int z = 0; z < crowd_size; ++z)
+            {
+                auto & instance = wolves.instances.emplace_back();
+                instance.animation = animation_distribution(rng);
+                instance.phase = phase_distribution(rng) * 0.25f;
+                instance.transform = glm::translate(glm::mat4(1.f), {(x - 0.5f * (crowd_size - 1)) * 0.5f, 0.f, -z * 1.25f});
+            }
+        }
+    }
+
+    bone_palette palette(input_model.bones.size(), wolves.instances.size());
+
+    auto const skinning_vertex_shader_source = "#version 330 core\n" + palette.shader_defines() + vertex_shader_source;
+
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, skinning_vertex_shader_source.c_str());
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
-    GLuint model_location = glGetUniformLocation(program, "model");
-    GLuint view_location = glGetUniformLocation(program, "view");
-    GLuint projection_location = glGetUniformLocation(program, "projection");
-    GLuint albedo_location = glGetUniformLocation(program, "albedo");
-    GLuint color_location = glGetUniformLocation(program, "color");
-    GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
-    GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
+    glUseProgram(program);
+    palette.setup_program(program);
 
-    const std::string project_root = PROJECT_ROOT;
-    const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+    GLuint palette_offset_location = glGetUniformLocation(program, "palette_offset");
+
+    // The same crowd animated from a vertex animation texture, with no
+    // per-frame CPU work at all
+    auto const vat_content = vertex_animation_texture::content_type::bone_matrices;
+    auto const vat = bake_vertex_animation_texture(input_model, animation_names, vat_content, 30.f, false, 2048, &pool);
+
+    // The bind pose bounds don't contain the animated poses, so instances
+    // are culled against bounds baked from every clip
+    auto const bounds = bake_animated_bounds(input_model, animation_names, 30.f, &pool);
+
+    std::string vat_defines = "#define MAX_CLIPS " + std::to_string(vat.clips.size()) + "\n";
+    if (vat_content == vertex_animation_texture::content_type::vertices)
+        vat_defines += "#define VAT_VERTICES\n";
+
+    auto const vat_vertex_shader = create_shader(GL_VERTEX_SHADER, ("#version 330 core\n" + vat_defines + vat_vertex_shader_source).c_str());
+    auto const vat_program = create_program(vat_vertex_shader, fragment_shader);
+
+    GLuint vat_texture;
+    glGenTextures(1, &vat_texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, vat_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    if (vat.half_float)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, vat.width, vat.height, 0, GL_RGBA, GL_HALF_FLOAT, vat.half_data.data());
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, vat.width, vat.height, 0, GL_RGBA, GL_FLOAT, vat.data.data());
+    glActiveTexture(GL_TEXTURE0);
+
+    glUseProgram(vat_program);
+    {
+        std::vector<glm::ivec2> clips;
+        for (auto const & clip : vat.clips)
+            clips.emplace_back(clip.first_frame, clip.frame_count);
+
+        glUniform1i(glGetUniformLocation(vat_program, "animation_texture"), 2);
+        glUniform1i(glGetUniformLocation(vat_program, "texels_per_frame"), vat.texels_per_frame);
+        glUniform1f(glGetUniformLocation(vat_program, "frame_rate"), vat.frame_rate);
+        glUniform2iv(glGetUniformLocation(vat_program, "clips"), clips.size(), reinterpret_cast<GLint const *>(clips.data()));
+    }
+    GLuint vat_time_location = glGetUniformLocation(vat_program, "time");
+    GLuint vat_vertex_offset_location = glGetUniformLocation(vat_program, "vertex_offset");
+
+    struct program_uniforms
+    {
+        GLuint program;
+        GLuint view_location;
+        GLuint projection_location;
+        GLuint color_location;
+        GLuint use_texture_location;
+        GLuint light_direction_location;
+    };
+
+    auto get_uniforms = [](GLuint program)
+    {
+        return program_uniforms{
+            program,
+            static_cast<GLuint>(glGetUniformLocation(program, "view")),
+            static_cast<GLuint>(glGetUniformLocation(program, "projection")),
+            static_cast<GLuint>(glGetUniformLocation(program, "color")),
+            static_cast<GLuint>(glGetUniformLocation(program, "use_texture")),
+            static_cast<GLuint>(glGetUniformLocation(program, "light_direction")),
+        };
+    };
+
+    auto const skinning_uniforms = get_uniforms(program);
+    auto const vat_uniforms = get_uniforms(vat_program);
 
-    auto const input_model = load_gltf(model_path);
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -200,17 +423,61 @@ int main() try
         GLuint vao;
         gltf_model::accessor indices;
         gltf_model::material material;
+        // Morphed positions followed by normals, for meshes with morph targets
+        GLuint morph_vbo = 0;
+        // The unmorphed positions and normals in the same layout, as floats
+        std::vector<glm::vec3> morph_base;
+        // Meshes with equal materials share the id, and so the state of
+        // their draws, see render_queue
+        std::uint32_t material_id;
+        // Center of the bounds in the first frame of the first clip, for
+        // ordering the draws by depth
+        glm::vec3 center;
     };
 
     auto setup_attribute = [](int index, gltf_model::accessor const & accessor, bool integer = false)
     {
         glEnableVertexAttribArray(index);
         if (integer)
-            glVertexAttribIPointer(index, accessor.size, accessor.type, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribIPointer(index, accessor.size, accessor.type, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
         else
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribPointer(index, accessor.size, accessor.type, accessor.normalized ? GL_TRUE : GL_FALSE, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
+    };
+
+    struct instance_data
+    {
+        glm::mat4 transform;
+        // Clip index and time offset, for the vertex animation texture path
+        glm::vec2 animation;
+    };
+
+    // Only the visible instances are uploaded every frame
+    std::vector<instance_data> instances;
+    std::vector<std::uint32_t> visible_instances;
+
+    GLuint instance_vbo;
+    glGenBuffers(1, &instance_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, wolves.instances.size() * sizeof(instance_data), nullptr, GL_STREAM_DRAW);
+
+    std::vector<gltf_model::material const *> unique_materials;
+    auto material_id = [&](gltf_model::material const & material)
+    {
+        for (std::uint32_t i = 0; i < unique_materials.size(); ++i)
+        {
+            auto const & other = *unique_materials[i];
+            if (other.two_sided == material.two_sided && other.transparent == material.transparent
+                && other.texture_path == material.texture_path && other.color == material.color)
+                return i;
+        }
+        unique_materials.push_back(&material);
+        return static_cast<std::uint32_t>(unique_materials.size() - 1);
     };
 
+    std::vector<bone_transform> rest_palette(input_model.bones.size());
+    compute_bone_palette(input_model, *wolves.animations[0], 0.f, rest_palette);
+    skinned_vertices rest_vertices;
+
     std::vector<mesh> meshes;
     for (auto const & mesh : input_model.meshes)
     {
@@ -221,53 +488,83 @@ int main() try
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
         result.indices = mesh.indices;
 
-        setup_attribute(0, mesh.position);
-        setup_attribute(1, mesh.normal);
+        if (mesh.targets.empty())
+        {
+            setup_attribute(0, mesh.position);
+            setup_attribute(1, mesh.normal);
+        }
+        else
+        {
+            if (mesh.normal.count != mesh.position.count)
+                throw std::runtime_error("Mesh " + mesh.name + " has a different number of normals and positions");
+
+            result.morph_base = read_float_accessor<glm::vec3>(input_model, mesh.position);
+            auto const base_normals = read_float_accessor<glm::vec3>(input_model, mesh.normal);
+            result.morph_base.insert(result.morph_base.end(), base_normals.begin(), base_normals.end());
+
+            glGenBuffers(1, &result.morph_vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, result.morph_vbo);
+            glBufferData(GL_ARRAY_BUFFER, 2 * mesh.position.count * sizeof(glm::vec3), nullptr, GL_STREAM_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(mesh.position.count * sizeof(glm::vec3)));
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        }
         setup_attribute(2, mesh.texcoord);
         setup_attribute(3, mesh.joints, true);
         setup_attribute(4, mesh.weights);
 
-        result.material = mesh.material;
-    }
-
-    std::map<std::string, GLuint> textures;
-    for (auto const & mesh : meshes)
-    {
-        if (!mesh.material.texture_path) continue;
-        if (textures.contains(*mesh.material.texture_path)) continue;
-
-        auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
-
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
-
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        for (int i = 0; i < 4; ++i)
+        {
+            glEnableVertexAttribArray(5 + i);
+            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), reinterpret_cast<void *>(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + i, 1);
+        }
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 2, GL_FLOAT, GL_FALSE, sizeof(instance_data), reinterpret_cast<void *>(offsetof(instance_data, animation)));
+        glVertexAttribDivisor(9, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-        stbi_image_free(data);
+        result.material = mesh.material;
+        // The top bit keeps the single- and double-sided materials apart,
+        // so that face culling only toggles once per pass
+        result.material_id = material_id(mesh.material) | (mesh.material.two_sided ? 0x8000 : 0);
 
-        textures[*mesh.material.texture_path] = texture;
+        // Meshes without a skin are in the rest pose already
+        if (mesh.joints.count == 0)
+            rest_vertices.positions = read_float_accessor<glm::vec3>(input_model, mesh.position);
+        else
+            skin_vertices(input_model, mesh, rest_palette, rest_vertices);
+        glm::vec3 min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity());
+        for (auto const & p : rest_vertices.positions)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        result.center = rest_vertices.positions.empty() ? glm::vec3(0.f) : (min + max) * 0.5f;
     }
 
+    render_queue queue;
+    gl_state state;
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
+    float last_stats_time = 0.f;
+    float last_state_stats_time = 0.f;
 
     std::map<SDL_Keycode, bool> button_down;
 
     float view_angle = glm::pi<float>() / 8.f;
-    float camera_distance = 0.75f;
+    float camera_distance = 3.f;
 
     float camera_rotation = glm::pi<float>() * (- 1.f / 3.f);
-    float camera_height = 0.25f;
+    float camera_height = 0.5f;
 
     bool paused = false;
+    bool use_vat = false;
 
     bool running = true;
     while (running)
@@ -282,7 +579,6 @@ int main() try
             case SDL_WINDOWEVENT_RESIZED:
                 width = event.window.data1;
                 height = event.window.data2;
-                glViewport(0, 0, width, height);
                 break;
             }
             break;
@@ -290,6 +586,8 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_v)
+                use_vat = !use_vat;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -321,18 +619,20 @@ int main() try
         if (button_down[SDLK_s])
             view_angle += 2.f * dt;
 
+        textures.update();
+        state.invalidate_bindings();
+
+        state.viewport(0, 0, width, height);
         glClearColor(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_DEPTH_TEST);
+        state.enable(GL_DEPTH_TEST);
 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model(1.f);
-
         glm::mat4 view(1.f);
         view = glm::translate(view, {0.f, 0.f, -camera_distance});
         view = glm::rotate(view, view_angle, {1.f, 0.f, 0.f});
@@ -343,53 +643,159 @@ int main() try
 
         glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
 
+        frustum const view_frustum(projection * view);
+
+        visible_instances.clear();
+        instances.clear();
+        for (std::uint32_t i = 0; i < wolves.instances.size(); ++i)
+        {
+            auto const & instance = wolves.instances[i];
+
+            auto const [local_min, local_max] = bounds.at(instance.animation, time + instance.phase);
+            auto const [min, max] = transform_bounds(instance.transform, local_min, local_max);
+            if (!intersect(aabb(min, max), view_frustum)) continue;
+
+            visible_instances.push_back(i);
+            instances.push_back({instance.transform, glm::vec2(instance.animation, instance.phase)});
+        }
+
+        state.bind_buffer(GL_ARRAY_BUFFER, instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, wolves.instances.size() * sizeof(instance_data), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(instance_data), instances.data());
+
+        if (!use_vat)
+        {
+            auto const crowd_stats = wolves.update(time, camera_position, visible_instances, palette.data, palette.instance_stride);
+            palette.upload(visible_instances.size());
+            state.invalidate_bindings();
+
+            if (time - last_stats_time > 1.f)
+            {
+                last_stats_time = time;
+                std::cout << "visible: " << visible_instances.size() << " of " << wolves.instances.size()
+                    << ", poses evaluated: " << crowd_stats.poses_evaluated << ", reused: " << crowd_stats.poses_reused << ", instances per LOD:";
+                for (auto count : crowd_stats.instances_per_lod)
+                    std::cout << ' ' << count;
+                std::cout << std::endl;
+            }
+        }
+
+        // Morph targets are shared by the whole crowd and follow the first clip
+        std::vector<float> morph_weights;
+        std::vector<glm::vec3> morphed;
+        for (std::size_t m = 0; m < meshes.size(); ++m)
+        {
+            auto const & mesh = input_model.meshes[m];
+            if (mesh.targets.empty()) continue;
+
+            morph_weights.resize(mesh.targets.size());
+            sample_morph_weights(mesh, m, *wolves.animations[0], time, morph_weights);
+
+            morphed = meshes[m].morph_base;
+
+            apply_morph_targets(mesh, morph_weights,
+                std::span{morphed.data(), mesh.position.count},
+                std::span{morphed.data() + mesh.position.count, mesh.position.count});
+
+            state.bind_buffer(GL_ARRAY_BUFFER, meshes[m].morph_vbo);
+            glBufferData(GL_ARRAY_BUFFER, morphed.size() * sizeof(morphed[0]), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, morphed.size() * sizeof(morphed[0]), morphed.data());
+        }
+
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        auto const & uniforms = use_vat ? vat_uniforms : skinning_uniforms;
 
-        auto draw_meshes = [&](bool transparent)
+        state.use_program(uniforms.program);
+        if (use_vat)
+            glUniform1f(vat_time_location, time);
+        else
+        {
+            palette.bind(palette_offset_location, 0);
+            state.invalidate_bindings();
+        }
+        glUniformMatrix4fv(uniforms.view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+        glUniformMatrix4fv(uniforms.projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+        glUniform3fv(uniforms.light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+
+        // The meshes of the instance closest to the camera stand for the
+        // whole instanced draw in the depth order
+        glm::mat4 nearest_transform(1.f);
+        float nearest_depth = std::numeric_limits<float>::infinity();
+        for (auto const & instance : instances)
         {
-            for (auto const & mesh : meshes)
+            float const depth = -(view * instance.transform[3]).z;
+            if (depth < nearest_depth)
             {
-                if (mesh.material.transparent != transparent)
-                    continue;
+                nearest_depth = depth;
+                nearest_transform = instance.transform;
+            }
+        }
 
-                if (mesh.material.two_sided)
-                    glDisable(GL_CULL_FACE);
-                else
-                    glEnable(GL_CULL_FACE);
+        queue.clear();
+        for (std::uint32_t m = 0; m < meshes.size(); ++m)
+        {
+            auto const & mesh = meshes[m];
+            if (!mesh.material.texture_path && !mesh.material.color)
+                continue;
 
-                if (transparent)
-                    glEnable(GL_BLEND);
-                else
-                    glDisable(GL_BLEND);
+            float const depth = -(view * nearest_transform * glm::vec4(mesh.center, 1.f)).z;
+            queue.push(make_sort_key(mesh.material.transparent ? render_pass::transparent : render_pass::opaque,
+                use_vat ? 1 : 0, mesh.material_id, (depth - near) / (far - near)), m);
+        }
+        queue.sort();
+
+        // Material uniforms are only set when the material differs from
+        // the previous draw; the sort puts equal states next to each other,
+        // and the state tracker drops the remaining redundant GL calls
+        std::optional<render_pass> current_pass;
+        std::optional<std::uint32_t> current_material;
+
+        for (auto const & item : queue.items)
+        {
+            auto const & mesh = meshes[item.index];
+
+            render_pass const pass = sort_key_pass(item.key);
+            if (pass != current_pass)
+            {
+                bool const transparent = (pass == render_pass::transparent);
+                state.enable(GL_BLEND, transparent);
+                state.depth_mask(!transparent);
+                current_pass = pass;
+            }
+
+            if (mesh.material_id != current_material)
+            {
+                state.enable(GL_CULL_FACE, !mesh.material.two_sided);
 
                 if (mesh.material.texture_path)
                 {
-                    glBindTexture(GL_TEXTURE_2D, textures[*mesh.material.texture_path]);
-                    glUniform1i(use_texture_location, 1);
+                    state.bind_texture(0, GL_TEXTURE_2D, textures.texture(texture_handles.at(*mesh.material.texture_path)));
+                    glUniform1i(uniforms.use_texture_location, 1);
                 }
-                else if (mesh.material.color)
+                else
                 {
-                    glUniform1i(use_texture_location, 0);
-                    glUniform4fv(color_location, 1, reinterpret_cast<const float *>(&(*mesh.material.color)));
+                    glUniform1i(uniforms.use_texture_location, 0);
+                    glUniform4fv(uniforms.color_location, 1, reinterpret_cast<const float *>(&(*mesh.material.color)));
                 }
-                else
-                    continue;
-
-                glBindVertexArray(mesh.vao);
-                glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+                current_material = mesh.material_id;
             }
-        };
 
-        draw_meshes(false);
-        glDepthMask(GL_FALSE);
-        draw_meshes(true);
-        glDepthMask(GL_TRUE);
+            if (use_vat)
+                glUniform1i(vat_vertex_offset_location, vat.mesh_vertex_offsets[item.index]);
+
+            state.bind_vertex_array(mesh.vao);
+            glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset), visible_instances.size());
+        }
+        state.depth_mask(true);
+
+        if (time - last_state_stats_time > 1.f)
+        {
+            last_state_stats_time = time;
+            auto const & calls = state.frame_counters();
+            std::cout << "GL state calls: " << calls.issued << " issued, " << calls.filtered << " filtered" << std::endl;
+        }
+        state.reset_counters();
 
         SDL_GL_SwapWindow(window);
     }
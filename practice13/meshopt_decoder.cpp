@@ -0,0 +1,668 @@
+#include "meshopt_decoder.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSSE3__) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#define MESHOPT_SSE
+#endif
+
+namespace
+{
+
+    constexpr unsigned char vertex_header = 0xa0;
+    constexpr unsigned char index_header = 0xe0;
+    constexpr unsigned char sequence_header = 0xd0;
+
+    constexpr std::size_t byte_group_size = 16;
+    // A byte group never reads more than this; the encoder pads the stream
+    // with a tail so that reads near its end stay in bounds
+    constexpr std::size_t byte_group_decode_limit = 24;
+    constexpr std::size_t vertex_block_size_bytes = 8192;
+    constexpr std::size_t vertex_block_max_size = 256;
+    constexpr std::size_t tail_max_size = 32;
+
+    [[noreturn]] void malformed(char const * what)
+    {
+        throw std::runtime_error(std::string("Malformed meshopt data: ") + what);
+    }
+
+    unsigned char unzigzag(unsigned char v)
+    {
+        return (0 - (v & 1)) ^ (v >> 1);
+    }
+
+#ifdef MESHOPT_SSE
+
+    // For every 8-bit mask of escaped values in one half of a byte group,
+    // which byte of the escape stream each value takes (0x80 for none), and
+    // how many escape bytes the half consumes
+    struct byte_group_tables
+    {
+        unsigned char shuffle[256][8];
+        unsigned char count[256];
+
+        byte_group_tables()
+        {
+            for (int mask = 0; mask < 256; ++mask)
+            {
+                unsigned char next = 0;
+                for (int i = 0; i < 8; ++i)
+                    shuffle[mask][i] = (mask & (1 << i)) ? next++ : 0x80;
+                count[mask] = next;
+            }
+        }
+    };
+
+    byte_group_tables const tables;
+
+#endif
+
+    // Decodes 16 bytes packed with 0, 2, 4 or 8 bits each; a 2- or 4-bit
+    // value with all bits set is an escape, the actual byte follows the
+    // packed bits
+    unsigned char const * decode_bytes_group(unsigned char const * data, unsigned char * buffer, int bits_log2)
+    {
+        if (bits_log2 == 0)
+        {
+            std::memset(buffer, 0, byte_group_size);
+            return data;
+        }
+
+        if (bits_log2 == 3)
+        {
+            std::memcpy(buffer, data, byte_group_size);
+            return data + byte_group_size;
+        }
+
+#ifdef MESHOPT_SSE
+        __m128i values;
+        std::size_t packed_size;
+
+        // Spread the packed values into bytes, most significant bits first
+        if (bits_log2 == 1)
+        {
+            std::int32_t packed;
+            std::memcpy(&packed, data, sizeof(packed));
+            __m128i const sel2 = _mm_cvtsi32_si128(packed);
+            __m128i const sel22 = _mm_unpacklo_epi8(_mm_srli_epi16(sel2, 4), sel2);
+            __m128i const sel2222 = _mm_unpacklo_epi8(_mm_srli_epi16(sel22, 2), sel22);
+            values = _mm_and_si128(sel2222, _mm_set1_epi8(3));
+            packed_size = 4;
+        }
+        else
+        {
+            __m128i const sel4 = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(data));
+            __m128i const sel44 = _mm_unpacklo_epi8(_mm_srli_epi16(sel4, 4), sel4);
+            values = _mm_and_si128(sel44, _mm_set1_epi8(15));
+            packed_size = 8;
+        }
+
+        __m128i const escaped = _mm_cmpeq_epi8(values, _mm_set1_epi8(bits_log2 == 1 ? 3 : 15));
+        int const mask = _mm_movemask_epi8(escaped);
+        int const mask0 = mask & 255;
+        int const mask1 = mask >> 8;
+
+        // Move the escape bytes into the escaped positions
+        __m128i const shuffle = _mm_unpacklo_epi64(
+            _mm_loadl_epi64(reinterpret_cast<__m128i const *>(tables.shuffle[mask0])),
+            _mm_add_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(tables.shuffle[mask1])), _mm_set1_epi8(tables.count[mask0])));
+        __m128i const rest = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + packed_size));
+
+        __m128i const result = _mm_or_si128(_mm_shuffle_epi8(rest, shuffle), _mm_andnot_si128(escaped, values));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(buffer), result);
+
+        return data + packed_size + tables.count[mask0] + tables.count[mask1];
+#else
+        int const bits = 1 << bits_log2;
+        unsigned char const escape = (1 << bits) - 1;
+
+        unsigned char const * rest = data + byte_group_size * bits / 8;
+        for (std::size_t i = 0; i < byte_group_size; ++i)
+        {
+            unsigned char const value = (data[i * bits / 8] >> (8 - bits - (i * bits) % 8)) & escape;
+            buffer[i] = (value == escape) ? *rest++ : value;
+        }
+        return rest;
+#endif
+    }
+
+    unsigned char const * decode_bytes(unsigned char const * data, unsigned char const * data_end, unsigned char * buffer, std::size_t buffer_size)
+    {
+        // Two bits of header per group
+        std::size_t const header_size = (buffer_size / byte_group_size + 3) / 4;
+        if (std::size_t(data_end - data) < header_size)
+            malformed("truncated vertex data");
+
+        unsigned char const * header = data;
+        data += header_size;
+
+        for (std::size_t i = 0; i < buffer_size; i += byte_group_size)
+        {
+            if (std::size_t(data_end - data) < byte_group_decode_limit)
+                malformed("truncated vertex data");
+
+            std::size_t const group = i / byte_group_size;
+            data = decode_bytes_group(data, buffer + i, (header[group / 4] >> ((group % 4) * 2)) & 3);
+        }
+
+        return data;
+    }
+
+    // Undoes the zigzag and delta encoding of one byte of every vertex in a
+    // block, writing the bytes to their places in the interleaved vertices
+    void decode_deltas(unsigned char const * buffer, std::size_t count, unsigned char & last, unsigned char * destination, std::size_t stride)
+    {
+        unsigned char p = last;
+        std::size_t i = 0;
+
+#ifdef MESHOPT_SSE
+        for (; i + byte_group_size <= count; i += byte_group_size)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(buffer + i));
+
+            __m128i const half = _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(127));
+            __m128i const sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1)));
+            v = _mm_xor_si128(half, sign);
+
+            // Inclusive prefix sum over the 16 bytes
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(p)));
+
+            alignas(16) unsigned char values[byte_group_size];
+            _mm_store_si128(reinterpret_cast<__m128i *>(values), v);
+
+            for (std::size_t j = 0; j < byte_group_size; ++j)
+                destination[(i + j) * stride] = values[j];
+            p = values[byte_group_size - 1];
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            p += unzigzag(buffer[i]);
+            destination[i * stride] = p;
+        }
+
+        last = p;
+    }
+
+    unsigned int decode_vbyte(unsigned char const *& data)
+    {
+        unsigned char const lead = *data++;
+        if (lead < 128)
+            return lead;
+
+        unsigned int result = lead & 127;
+        unsigned int shift = 7;
+        for (int i = 0; i < 4; ++i)
+        {
+            unsigned char const group = *data++;
+            result |= static_cast<unsigned int>(group & 127) << shift;
+            shift += 7;
+            if (group < 128)
+                break;
+        }
+        return result;
+    }
+
+    unsigned int decode_index(unsigned char const *& data, unsigned int last)
+    {
+        unsigned int const v = decode_vbyte(data);
+        return last + ((v >> 1) ^ (0u - (v & 1)));
+    }
+
+    void write_index(void * destination, std::size_t i, std::size_t index_size, unsigned int index)
+    {
+        if (index_size == 2)
+            static_cast<std::uint16_t *>(destination)[i] = static_cast<std::uint16_t>(index);
+        else
+            static_cast<std::uint32_t *>(destination)[i] = index;
+    }
+
+    void check_index_size(std::size_t index_size)
+    {
+        if (index_size != 2 && index_size != 4)
+            throw std::runtime_error("Unsupported meshopt index size: " + std::to_string(index_size));
+    }
+
+    template <typename T>
+    void decode_oct(T * data, std::size_t count)
+    {
+        float const max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            // z holds the encoding of 1 at the same precision
+            float x = data[i * 4 + 0];
+            float y = data[i * 4 + 1];
+            float const z = data[i * 4 + 2] - std::abs(x) - std::abs(y);
+
+            // Unfold the lower hemisphere
+            float const t = std::min(z, 0.f);
+            x -= std::copysign(t, x);
+            y -= std::copysign(t, y);
+
+            float const s = max / std::sqrt(x * x + y * y + z * z);
+
+            data[i * 4 + 0] = T(std::lround(x * s));
+            data[i * 4 + 1] = T(std::lround(y * s));
+            data[i * 4 + 2] = T(std::lround(z * s));
+        }
+    }
+
+    void write_quat(std::int16_t * data, int x, int y, int z, int w, int qc)
+    {
+        // The component that was dropped by the encoder is reconstructed as w
+        data[(qc + 1) & 3] = static_cast<std::int16_t>(x);
+        data[(qc + 2) & 3] = static_cast<std::int16_t>(y);
+        data[(qc + 3) & 3] = static_cast<std::int16_t>(z);
+        data[(qc + 0) & 3] = static_cast<std::int16_t>(w);
+    }
+
+#ifdef MESHOPT_SSE
+
+    // Normalizes octahedral coordinates to the range of the integer type
+    void decode_oct_simd(__m128 & x, __m128 & y, __m128 & z, float max)
+    {
+        __m128 const sign_mask = _mm_set1_ps(-0.f);
+
+        z = _mm_sub_ps(z, _mm_add_ps(_mm_andnot_ps(sign_mask, x), _mm_andnot_ps(sign_mask, y)));
+
+        __m128 const t = _mm_andnot_ps(sign_mask, _mm_min_ps(z, _mm_setzero_ps()));
+        x = _mm_sub_ps(x, _mm_xor_ps(t, _mm_and_ps(x, sign_mask)));
+        y = _mm_sub_ps(y, _mm_xor_ps(t, _mm_and_ps(y, sign_mask)));
+
+        __m128 const length_squared = _mm_add_ps(_mm_mul_ps(x, x), _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z)));
+        __m128 const s = _mm_div_ps(_mm_set1_ps(max), _mm_sqrt_ps(length_squared));
+
+        x = _mm_mul_ps(x, s);
+        y = _mm_mul_ps(y, s);
+        z = _mm_mul_ps(z, s);
+    }
+
+#endif
+
+}
+
+void meshopt_decode_vertex_buffer(void * destination, std::size_t count, std::size_t stride, unsigned char const * data, std::size_t size)
+{
+    if (stride == 0 || stride > 256 || stride % 4 != 0)
+        throw std::runtime_error("Unsupported meshopt vertex stride: " + std::to_string(stride));
+
+    unsigned char const * data_end = data + size;
+
+    if (size < 1 + stride)
+        malformed("truncated vertex data");
+    if ((data[0] & 0xf0) != vertex_header)
+        malformed("bad vertex header");
+    if ((data[0] & 0x0f) != 0)
+        throw std::runtime_error("Unsupported meshopt vertex codec version: " + std::to_string(data[0] & 0x0f));
+    ++data;
+
+    // Deltas of the first vertex are relative to the vertex stored in the tail
+    unsigned char last_vertex[256];
+    std::memcpy(last_vertex, data_end - stride, stride);
+
+    std::size_t const block_size = std::min((vertex_block_size_bytes / stride) & ~(byte_group_size - 1), vertex_block_max_size);
+
+    auto output = static_cast<unsigned char *>(destination);
+    unsigned char buffer[vertex_block_max_size];
+
+    for (std::size_t offset = 0; offset < count; offset += block_size)
+    {
+        std::size_t const block_count = std::min(block_size, count - offset);
+        std::size_t const aligned_count = (block_count + byte_group_size - 1) & ~(byte_group_size - 1);
+
+        // Each byte of the vertex is stored as its own stream
+        for (std::size_t k = 0; k < stride; ++k)
+        {
+            data = decode_bytes(data, data_end, buffer, aligned_count);
+            decode_deltas(buffer, block_count, last_vertex[k], output + offset * stride + k, stride);
+        }
+    }
+
+    if (std::size_t(data_end - data) != std::max(stride, tail_max_size))
+        malformed("unexpected vertex data size");
+}
+
+void meshopt_decode_index_buffer(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size)
+{
+    check_index_size(index_size);
+    if (count % 3 != 0)
+        malformed("index count is not a multiple of 3");
+
+    if (size < 1 + count / 3 + 16)
+        malformed("truncated index data");
+    if ((data[0] & 0xf0) != index_header)
+        malformed("bad index header");
+
+    int const version = data[0] & 0x0f;
+    if (version > 1)
+        throw std::runtime_error("Unsupported meshopt index codec version: " + std::to_string(version));
+
+    // The most recent edges and vertices, as ring buffers
+    unsigned int edge_fifo[16][2];
+    unsigned int vertex_fifo[16];
+    std::memset(edge_fifo, -1, sizeof(edge_fifo));
+    std::memset(vertex_fifo, -1, sizeof(vertex_fifo));
+    std::size_t edge_offset = 0;
+    std::size_t vertex_offset = 0;
+
+    auto push_edge = [&](unsigned int a, unsigned int b)
+    {
+        edge_fifo[edge_offset][0] = a;
+        edge_fifo[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    };
+
+    auto push_vertex = [&](unsigned int v, bool advance = true)
+    {
+        vertex_fifo[vertex_offset] = v;
+        vertex_offset = (vertex_offset + advance) & 15;
+    };
+
+    // Next vertex that hasn't been referenced yet, and the last explicitly encoded index
+    unsigned int next = 0;
+    unsigned int last = 0;
+
+    int const fec_max = (version >= 1) ? 13 : 15;
+
+    // One code byte per triangle, then the variable-length data, then a
+    // 16-byte table of common auxiliary codes; a triangle reads at most 16
+    // bytes of data, so the table also serves as padding
+    unsigned char const * code = data + 1;
+    unsigned char const * stream = code + count / 3;
+    unsigned char const * stream_safe_end = data + size - 16;
+    unsigned char const * codeaux_table = stream_safe_end;
+
+    for (std::size_t i = 0; i < count; i += 3)
+    {
+        if (stream > stream_safe_end)
+            malformed("truncated index data");
+
+        unsigned char const codetri = code[i / 3];
+
+        unsigned int a, b, c;
+
+        if (codetri < 0xf0)
+        {
+            // An edge from the edge fifo and one more vertex
+            auto const & edge = edge_fifo[(edge_offset - 1 - (codetri >> 4)) & 15];
+            a = edge[0];
+            b = edge[1];
+
+            int const fec = codetri & 15;
+            if (fec < fec_max)
+            {
+                bool const fec0 = fec == 0;
+                c = fec0 ? next++ : vertex_fifo[(vertex_offset - 1 - fec) & 15];
+                push_vertex(c, fec0);
+            }
+            else
+            {
+                // 13 and 14 are -1 and +1 relative to the last explicit index
+                last = c = (fec != 15) ? last + (fec - (fec ^ 3)) : decode_index(stream, last);
+                push_vertex(c);
+            }
+
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+        else
+        {
+            // A triangle that doesn't share an edge with the recent ones
+            int fea, feb, fec;
+            if (codetri < 0xfe)
+            {
+                unsigned char const codeaux = codeaux_table[codetri & 15];
+                fea = 0;
+                feb = codeaux >> 4;
+                fec = codeaux & 15;
+            }
+            else
+            {
+                unsigned char const codeaux = *stream++;
+                fea = (codetri == 0xfe) ? 0 : 15;
+                feb = codeaux >> 4;
+                fec = codeaux & 15;
+
+                if (codeaux == 0)
+                    next = 0;
+            }
+
+            // The order matters: next is incremented for all three vertices
+            // before explicit indices are decoded, as in the encoder
+            a = (fea == 0) ? next++ : 0;
+            b = (feb == 0) ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+            c = (fec == 0) ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+
+            if (fea == 15)
+                last = a = decode_index(stream, last);
+            if (feb == 15)
+                last = b = decode_index(stream, last);
+            if (fec == 15)
+                last = c = decode_index(stream, last);
+
+            push_vertex(a);
+            push_vertex(b, feb == 0 || feb == 15);
+            push_vertex(c, fec == 0 || fec == 15);
+
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+
+        write_index(destination, i + 0, index_size, a);
+        write_index(destination, i + 1, index_size, b);
+        write_index(destination, i + 2, index_size, c);
+    }
+
+    if (stream != stream_safe_end)
+        malformed("unexpected index data size");
+}
+
+void meshopt_decode_index_sequence(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size)
+{
+    check_index_size(index_size);
+
+    if (size < 1 + count + 4)
+        malformed("truncated index sequence");
+    if ((data[0] & 0xf0) != sequence_header)
+        malformed("bad index sequence header");
+    if ((data[0] & 0x0f) != 0)
+        throw std::runtime_error("Unsupported meshopt index sequence version: " + std::to_string(data[0] & 0x0f));
+
+    // An index reads at most 5 bytes, and the stream ends with a 4-byte tail
+    unsigned char const * stream = data + 1;
+    unsigned char const * stream_safe_end = data + size - 4;
+
+    // Indices are deltas against one of two baselines
+    unsigned int last[2] = {};
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (stream >= stream_safe_end)
+            malformed("truncated index sequence");
+
+        unsigned int v = decode_vbyte(stream);
+        unsigned int const baseline = v & 1;
+        v >>= 1;
+
+        unsigned int const index = last[baseline] + ((v >> 1) ^ (0u - (v & 1)));
+        last[baseline] = index;
+
+        write_index(destination, i, index_size, index);
+    }
+
+    if (stream != stream_safe_end)
+        malformed("unexpected index sequence size");
+}
+
+void meshopt_decode_filter_oct(void * data, std::size_t count, std::size_t stride)
+{
+    std::size_t i = 0;
+
+    if (stride == 4)
+    {
+        auto values = static_cast<std::int8_t *>(data);
+
+#ifdef MESHOPT_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i const n4 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i * 4));
+
+            // Sign-extend the bytes of every element
+            __m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n4, 24), 24));
+            __m128 y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n4, 16), 24));
+            __m128 z = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n4, 8), 24));
+
+            decode_oct_simd(x, y, z, 127.f);
+
+            __m128i const xr = _mm_and_si128(_mm_cvtps_epi32(x), _mm_set1_epi32(0xff));
+            __m128i const yr = _mm_slli_epi32(_mm_and_si128(_mm_cvtps_epi32(y), _mm_set1_epi32(0xff)), 8);
+            __m128i const zr = _mm_slli_epi32(_mm_and_si128(_mm_cvtps_epi32(z), _mm_set1_epi32(0xff)), 16);
+            __m128i const w = _mm_and_si128(n4, _mm_set1_epi32(0xff000000));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i * 4), _mm_or_si128(_mm_or_si128(xr, yr), _mm_or_si128(zr, w)));
+        }
+#endif
+
+        decode_oct(values + i * 4, count - i);
+    }
+    else if (stride == 8)
+    {
+        auto values = static_cast<std::int16_t *>(data);
+
+#ifdef MESHOPT_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 const n0 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i * 4)));
+            __m128 const n1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i * 4 + 8)));
+
+            // Gather the xy and zw pairs of the 4 elements
+            __m128i const xy = _mm_castps_si128(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i const zw = _mm_castps_si128(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+            __m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(xy, 16), 16));
+            __m128 y = _mm_cvtepi32_ps(_mm_srai_epi32(xy, 16));
+            __m128 z = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(zw, 16), 16));
+
+            decode_oct_simd(x, y, z, 32767.f);
+
+            __m128i const xyr = _mm_or_si128(_mm_and_si128(_mm_cvtps_epi32(x), _mm_set1_epi32(0xffff)), _mm_slli_epi32(_mm_cvtps_epi32(y), 16));
+            __m128i const zwr = _mm_or_si128(_mm_and_si128(_mm_cvtps_epi32(z), _mm_set1_epi32(0xffff)), _mm_and_si128(zw, _mm_set1_epi32(0xffff0000)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i * 4), _mm_unpacklo_epi32(xyr, zwr));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i * 4 + 8), _mm_unpackhi_epi32(xyr, zwr));
+        }
+#endif
+
+        decode_oct(values + i * 4, count - i);
+    }
+    else
+        throw std::runtime_error("Unsupported stride for the meshopt octahedral filter: " + std::to_string(stride));
+}
+
+void meshopt_decode_filter_quat(void * data, std::size_t count, std::size_t stride)
+{
+    if (stride != 8)
+        throw std::runtime_error("Unsupported stride for the meshopt quaternion filter: " + std::to_string(stride));
+
+    auto values = static_cast<std::int16_t *>(data);
+    float const scale = 1.f / std::sqrt(2.f);
+
+    std::size_t i = 0;
+
+#ifdef MESHOPT_SSE
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 const q0 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i * 4)));
+        __m128 const q1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i * 4 + 8)));
+
+        __m128i const xy = _mm_castps_si128(_mm_shuffle_ps(q0, q1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i const zc = _mm_castps_si128(_mm_shuffle_ps(q0, q1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        // The 4th component holds the scale in its high bits and the index
+        // of the dropped component in its 2 low bits
+        __m128i const code = _mm_srai_epi32(zc, 16);
+        __m128 const s = _mm_div_ps(_mm_set1_ps(scale), _mm_cvtepi32_ps(_mm_or_si128(code, _mm_set1_epi32(3))));
+
+        __m128 const x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(xy, 16), 16)), s);
+        __m128 const y = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(xy, 16)), s);
+        __m128 const z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(zc, 16), 16)), s);
+
+        __m128 const ww = _mm_sub_ps(_mm_set1_ps(1.f), _mm_add_ps(_mm_mul_ps(x, x), _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z))));
+        __m128 const w = _mm_sqrt_ps(_mm_max_ps(ww, _mm_setzero_ps()));
+
+        __m128 const full = _mm_set1_ps(32767.f);
+        alignas(16) std::int32_t xr[4], yr[4], zr[4], wr[4], qc[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(xr), _mm_cvtps_epi32(_mm_mul_ps(x, full)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(yr), _mm_cvtps_epi32(_mm_mul_ps(y, full)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(zr), _mm_cvtps_epi32(_mm_mul_ps(z, full)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(wr), _mm_cvtps_epi32(_mm_mul_ps(w, full)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(qc), _mm_and_si128(code, _mm_set1_epi32(3)));
+
+        // The output order differs per element
+        for (int j = 0; j < 4; ++j)
+            write_quat(values + (i + j) * 4, xr[j], yr[j], zr[j], wr[j], qc[j]);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        std::int16_t * q = values + i * 4;
+
+        float const s = scale / float(q[3] | 3);
+
+        float const x = q[0] * s;
+        float const y = q[1] * s;
+        float const z = q[2] * s;
+        float const w = std::sqrt(std::max(0.f, 1.f - x * x - y * y - z * z));
+
+        write_quat(q, std::lround(x * 32767.f), std::lround(y * 32767.f), std::lround(z * 32767.f), std::lround(w * 32767.f), q[3] & 3);
+    }
+}
+
+void meshopt_decode_filter_exp(void * data, std::size_t count, std::size_t stride)
+{
+    if (stride == 0 || stride % 4 != 0)
+        throw std::runtime_error("Unsupported stride for the meshopt exponential filter: " + std::to_string(stride));
+
+    auto values = static_cast<std::uint32_t *>(data);
+    std::size_t const value_count = count * (stride / 4);
+
+    std::size_t i = 0;
+
+#ifdef MESHOPT_SSE
+    for (; i + 4 <= value_count; i += 4)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(values + i));
+
+        // Signed 24-bit mantissa and signed 8-bit exponent
+        __m128i const m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+        __m128i const e = _mm_srai_epi32(v, 24);
+
+        __m128 const power = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+        _mm_storeu_ps(reinterpret_cast<float *>(values + i), _mm_mul_ps(power, _mm_cvtepi32_ps(m)));
+    }
+#endif
+
+    for (; i < value_count; ++i)
+    {
+        std::int32_t const m = static_cast<std::int32_t>(values[i] << 8) >> 8;
+        std::int32_t const e = static_cast<std::int32_t>(values[i]) >> 24;
+
+        float const result = std::bit_cast<float>(static_cast<std::uint32_t>(e + 127) << 23) * float(m);
+        values[i] = std::bit_cast<std::uint32_t>(result);
+    }
+}
@@ -0,0 +1,89 @@
+#include "morph.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define MORPH_AVX2
+#endif
+
+namespace
+{
+
+    // Weights below this don't visibly move anything
+    constexpr float min_weight = 1e-4f;
+
+    // result[i] += weight * delta[i]
+    void axpy(float weight, float const * delta, float * result, std::size_t count)
+    {
+        std::size_t i = 0;
+
+#ifdef MORPH_AVX2
+        __m256 const w = _mm256_set1_ps(weight);
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(result + i, _mm256_fmadd_ps(w, _mm256_loadu_ps(delta + i), _mm256_loadu_ps(result + i)));
+#endif
+
+        for (; i < count; ++i)
+            result[i] += weight * delta[i];
+    }
+
+}
+
+void sample_morph_weights(gltf_model::mesh const & mesh, unsigned int mesh_index, gltf_model::animation const & animation, float time, std::span<float> weights)
+{
+    assert(weights.size() >= mesh.targets.size());
+
+    std::copy(mesh.target_weights.begin(), mesh.target_weights.end(), weights.begin());
+
+    std::size_t const target_count = mesh.targets.size();
+
+    for (auto const & track : animation.morph_weights)
+    {
+        if (track.mesh != mesh_index || track.timestamps.empty()) continue;
+
+        if (animation.max_time > 0.f)
+            time = std::fmod(time, animation.max_time);
+
+        auto it = std::lower_bound(track.timestamps.begin(), track.timestamps.end(), time);
+
+        std::size_t key0, key1;
+        float t = 0.f;
+        if (it == track.timestamps.begin())
+            key0 = key1 = 0;
+        else if (it == track.timestamps.end())
+            key0 = key1 = track.timestamps.size() - 1;
+        else
+        {
+            key1 = it - track.timestamps.begin();
+            key0 = key1 - 1;
+            t = (time - track.timestamps[key0]) / (track.timestamps[key1] - track.timestamps[key0]);
+        }
+
+        for (std::size_t i = 0; i < target_count; ++i)
+            weights[i] = glm::mix(track.values[key0 * target_count + i], track.values[key1 * target_count + i], t);
+    }
+}
+
+void apply_morph_targets(gltf_model::mesh const & mesh, std::span<float const> weights, std::span<glm::vec3> positions, std::span<glm::vec3> normals)
+{
+    for (std::size_t i = 0; i < mesh.targets.size() && i < weights.size(); ++i)
+    {
+        float const weight = weights[i];
+        if (std::abs(weight) < min_weight) continue;
+
+        auto const & target = mesh.targets[i];
+
+        for (auto const & run : target.runs)
+        {
+            assert(run.first_vertex + run.vertex_count <= positions.size());
+
+            // A run of vec3 is a contiguous run of 3 * vertex_count floats
+            axpy(weight, &target.position_deltas[run.delta_offset].x, &positions[run.first_vertex].x, 3 * run.vertex_count);
+
+            if (!normals.empty() && !target.normal_deltas.empty())
+                axpy(weight, &target.normal_deltas[run.delta_offset].x, &normals[run.first_vertex].x, 3 * run.vertex_count);
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <span>
+
+// Weights of the mesh targets at the given time, or the default weights if
+// the animation doesn't animate this mesh
+void sample_morph_weights(gltf_model::mesh const & mesh, unsigned int mesh_index, gltf_model::animation const & animation, float time, std::span<float> weights);
+
+// Adds the weighted target deltas to the base positions and normals (which
+// should already hold the mesh's own attributes). Only the runs of vertices
+// stored in the targets are touched, and targets with zero weight are
+// skipped entirely, so the cost depends on the active targets only.
+// Normals may be empty to morph positions alone.
+void apply_morph_targets(gltf_model::mesh const & mesh, std::span<float const> weights, std::span<glm::vec3> positions, std::span<glm::vec3> normals);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// An unbounded lock-free queue for many producer threads and a single
+// consumer thread.
+//
+// Producers link their node to the head with one atomic exchange, so they
+// never wait for each other or for the consumer. The consumer owns the tail
+// and follows the links; a push that has exchanged the head but not linked
+// its node yet is simply not visible until the next try_pop.
+template <typename T>
+struct mpsc_queue
+{
+    mpsc_queue()
+        : head_(new node)
+        , tail_(head_.load(std::memory_order_relaxed))
+    {}
+
+    ~mpsc_queue()
+    {
+        while (try_pop());
+        delete tail_;
+    }
+
+    mpsc_queue(mpsc_queue const &) = delete;
+    mpsc_queue & operator = (mpsc_queue const &) = delete;
+
+    // Can be called from any thread
+    void push(T value)
+    {
+        auto n = new node;
+        n->value.emplace(std::move(value));
+        node * previous = head_.exchange(n, std::memory_order_acq_rel);
+        previous->next.store(n, std::memory_order_release);
+    }
+
+    // Must only be called from the consumer thread
+    std::optional<T> try_pop()
+    {
+        node * next = tail_->next.load(std::memory_order_acquire);
+        if (!next)
+            return std::nullopt;
+
+        // The next node becomes the new stub, its value moves out
+        std::optional<T> result = std::move(next->value);
+        next->value.reset();
+        delete tail_;
+        tail_ = next;
+        return result;
+    }
+
+private:
+    struct node
+    {
+        std::atomic<node *> next{nullptr};
+        std::optional<T> value;
+    };
+
+    std::atomic<node *> head_;
+    node * tail_;
+};
@@ -0,0 +1,77 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static constexpr std::uint64_t depth_bits = 24;
+static constexpr std::uint64_t depth_max = (1ull << depth_bits) - 1;
+static constexpr std::uint64_t program_mask = (1ull << 6) - 1;
+static constexpr std::uint64_t material_mask = (1ull << 16) - 1;
+
+std::uint64_t make_sort_key(render_pass pass, std::uint32_t program, std::uint32_t material, float depth)
+{
+    std::uint64_t const quantized_depth = std::lround(std::clamp(depth, 0.f, 1.f) * depth_max);
+    std::uint64_t const state = ((program & program_mask) << 16) | (material & material_mask);
+
+    std::uint64_t key = std::uint64_t(pass) << 62;
+    if (pass == render_pass::opaque)
+        key |= (state << 40) | (quantized_depth << 16);
+    else
+        key |= ((depth_max - quantized_depth) << 38) | (state << 16);
+
+    return key;
+}
+
+render_pass sort_key_pass(std::uint64_t key)
+{
+    return render_pass(key >> 62);
+}
+
+void render_queue::clear()
+{
+    items.clear();
+}
+
+void render_queue::push(std::uint64_t key, std::uint32_t index)
+{
+    items.push_back({key, index});
+}
+
+void render_queue::sort()
+{
+    std::size_t const count = items.size();
+    if (count < 2)
+        return;
+
+    std::array<std::array<std::uint32_t, 256>, 8> histograms{};
+    for (auto const & item : items)
+    {
+        for (int byte = 0; byte < 8; ++byte)
+            ++histograms[byte][(item.key >> (8 * byte)) & 0xff];
+    }
+
+    scratch_.resize(count);
+
+    for (int byte = 0; byte < 8; ++byte)
+    {
+        auto & histogram = histograms[byte];
+        std::uint32_t const first_key_bucket = (items[0].key >> (8 * byte)) & 0xff;
+        if (histogram[first_key_bucket] == count)
+            continue;
+
+        // Bucket counts to bucket starts
+        std::uint32_t offset = 0;
+        for (auto & bucket : histogram)
+        {
+            std::uint32_t const size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+
+        for (auto const & item : items)
+            scratch_[histogram[(item.key >> (8 * byte)) & 0xff]++] = item;
+
+        items.swap(scratch_);
+    }
+}
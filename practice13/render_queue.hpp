@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class render_pass : std::uint8_t
+{
+    opaque = 0,
+    transparent = 1,
+};
+
+// Packs the state of a draw into a 64-bit key, so that sorting the keys
+// orders the draws for submission. Opaque draws are grouped by program
+// and material to minimize state changes, and go front-to-back within a
+// material so that early depth testing rejects more fragments. Transparent
+// draws must blend back-to-front, so their depth comes first and only
+// equally distant draws are grouped by state:
+//
+//     opaque:      pass:2 | program:6 | material:16 | depth:24 | unused:16
+//     transparent: pass:2 | depth:24 (inverted) | program:6 | material:16 | unused:16
+//
+// depth is the distance to the camera mapped to [0, 1], e.g. the view
+// space depth relative to the near and far planes; values outside of it
+// are clamped
+std::uint64_t make_sort_key(render_pass pass, std::uint32_t program, std::uint32_t material, float depth);
+
+render_pass sort_key_pass(std::uint64_t key);
+
+struct draw_item
+{
+    std::uint64_t key;
+    // Index of the draw in the caller's own arrays
+    std::uint32_t index;
+};
+
+// Draws collected over a frame and submitted in the order of their keys
+struct render_queue
+{
+    std::vector<draw_item> items;
+
+    void clear();
+    void push(std::uint64_t key, std::uint32_t index);
+
+    // Stable LSD radix sort of the items by key, 8 bits per pass. All eight
+    // histograms are built in one pass over the items, and the bytes that
+    // are the same in every key (the unused bits, a single program, ...)
+    // are skipped, so a typical frame takes far fewer than eight passes
+    void sort();
+
+private:
+    std::vector<draw_item> scratch_;
+};
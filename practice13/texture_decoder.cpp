@@ -0,0 +1,60 @@
+#include "texture_decoder.hpp"
+#include "stb_image.h"
+
+#include <stdexcept>
+
+texture_decoder::texture_decoder(thread_pool & pool)
+    : pool_(pool)
+    , state_(std::make_shared<shared_state>())
+{}
+
+void texture_decoder::submit(std::string name, std::filesystem::path path)
+{
+    ++submitted_;
+
+    pool_.submit([state = state_, name = std::move(name), path = std::move(path)]
+    {
+        result result;
+        result.image.name = name;
+
+        int channels;
+        auto pixels = stbi_load(path.string().c_str(), &result.image.width, &result.image.height, &channels, 4);
+        if (pixels)
+            result.image.pixels = {pixels, stbi_image_free};
+        else
+            result.error = "Failed to load " + path.string() + ": " + stbi_failure_reason();
+
+        state->ready.push(std::move(result));
+        state->completed.fetch_add(1);
+        state->completed.notify_all();
+    });
+}
+
+std::optional<decoded_image> texture_decoder::pop()
+{
+    while (pending() > 0)
+    {
+        // The counter is read before looking into the queue, so a push that
+        // lands in between makes the wait return immediately
+        std::uint32_t const completed = state_->completed.load();
+        if (auto image = try_pop())
+            return image;
+        state_->completed.wait(completed);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<decoded_image> texture_decoder::try_pop()
+{
+    auto result = state_->ready.try_pop();
+    if (!result)
+        return std::nullopt;
+
+    ++popped_;
+
+    if (!result->error.empty())
+        throw std::runtime_error(result->error);
+
+    return std::move(result->image);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "mpsc_queue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+
+// An RGBA8 image decoded by stb_image
+struct decoded_image
+{
+    std::string name;
+    int width = 0;
+    int height = 0;
+    std::unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, nullptr};
+};
+
+// Reads and decodes images on the pool threads and hands them back through a
+// lock-free queue, so that the GL thread can upload every image as soon as it
+// is ready instead of decoding them one after another itself.
+//
+// submit() and the pops must be called from the same thread.
+struct texture_decoder
+{
+    explicit texture_decoder(thread_pool & pool);
+
+    // Starts decoding the file; the result is returned by a pop under the given name
+    void submit(std::string name, std::filesystem::path path);
+
+    // Blocks until the next image is decoded, in completion order; returns
+    // nothing once every submitted image has been returned. Rethrows
+    // decoding errors
+    std::optional<decoded_image> pop();
+
+    // Like pop(), but returns nothing right away if no image is decoded yet
+    std::optional<decoded_image> try_pop();
+
+    // Number of submitted images not returned yet
+    std::size_t pending() const { return submitted_ - popped_; }
+
+private:
+    struct result
+    {
+        decoded_image image;
+        std::string error;
+    };
+
+    // Shared with the decoding tasks, so that the decoder can be destroyed
+    // while images are still being decoded
+    struct shared_state
+    {
+        mpsc_queue<result> ready;
+        std::atomic<std::uint32_t> completed{0};
+    };
+
+    thread_pool & pool_;
+    std::shared_ptr<shared_state> state_;
+    std::uint32_t submitted_ = 0;
+    std::uint32_t popped_ = 0;
+};
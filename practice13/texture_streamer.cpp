@@ -0,0 +1,128 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+texture_streamer::texture_streamer(thread_pool & pool, std::size_t upload_budget, std::size_t ring_size)
+    : decoder_(pool)
+    , upload_budget_(upload_budget)
+    , ring_(std::max<std::size_t>(ring_size, 1))
+{
+    std::uint8_t const grey[4] = {128, 128, 128, 255};
+
+    glGenTextures(1, &placeholder_);
+    glBindTexture(GL_TEXTURE_2D, placeholder_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+    for (auto & staging : ring_)
+    {
+        glGenBuffers(1, &staging.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, upload_budget_, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+texture_streamer::handle texture_streamer::request(std::filesystem::path const & path)
+{
+    auto [it, inserted] = handles_.emplace(path.string(), textures_.size());
+    if (inserted)
+    {
+        textures_.push_back(placeholder_);
+        decoder_.submit(path.string(), path);
+    }
+    return it->second;
+}
+
+void texture_streamer::update()
+{
+    // Decoded images get their texture storage right away, the pixels follow
+    // in strips
+    while (auto image = decoder_.try_pop())
+    {
+        if (image->width * 4ull > upload_budget_)
+            throw std::runtime_error("Texture upload budget is smaller than a row of " + image->name);
+
+        auto & upload = uploads_.emplace_back();
+        upload.target = handles_.at(image->name);
+        upload.image = std::move(*image);
+
+        glGenTextures(1, &upload.texture);
+        glBindTexture(GL_TEXTURE_2D, upload.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, upload.image.width, upload.image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    if (uploads_.empty())
+        return;
+
+    // The GPU may still be copying out of this buffer; mapping it now would
+    // stall, so the upload waits for a later frame instead
+    auto & staging = ring_[ring_index_];
+    if (staging.fence)
+    {
+        if (glClientWaitSync(staging.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return;
+        glDeleteSync(staging.fence);
+        staging.fence = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+    auto data = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, upload_budget_, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!data)
+        throw std::runtime_error("Failed to map a texture staging buffer");
+
+    struct strip
+    {
+        upload const * source;
+        int first_row;
+        int row_count;
+        std::size_t offset;
+    };
+
+    // Images are uploaded in order, the budget is filled with whole rows
+    std::vector<strip> strips;
+    std::size_t used = 0;
+    for (auto & upload : uploads_)
+    {
+        std::size_t const row_size = upload.image.width * 4ull;
+        int const row_count = std::min<std::size_t>(upload.image.height - upload.next_row, (upload_budget_ - used) / row_size);
+        if (row_count == 0)
+            break;
+
+        std::memcpy(data + used, upload.image.pixels.get() + upload.next_row * row_size, row_count * row_size);
+        strips.push_back({&upload, upload.next_row, row_count, used});
+
+        upload.next_row += row_count;
+        used += row_count * row_size;
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    for (auto const & strip : strips)
+    {
+        glBindTexture(GL_TEXTURE_2D, strip.source->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, strip.first_row, strip.source->image.width, strip.row_count, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void *>(strip.offset));
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring_index_ = (ring_index_ + 1) % ring_.size();
+
+    // Fully uploaded textures replace their placeholders
+    while (!uploads_.empty() && uploads_.front().next_row == uploads_.front().image.height)
+    {
+        auto & upload = uploads_.front();
+
+        glBindTexture(GL_TEXTURE_2D, upload.texture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        textures_[upload.target] = upload.texture;
+        uploads_.pop_front();
+    }
+}
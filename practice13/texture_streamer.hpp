@@ -0,0 +1,69 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "texture_decoder.hpp"
+
+// Textures that load in the background while the application renders.
+//
+// A requested texture is usable right away: until its image is decoded and
+// fully uploaded, texture() returns a shared placeholder. Files are read and
+// decoded on the pool threads; the GL thread picks the decoded images up in
+// update() and copies them to the GPU in row strips through a ring of pixel
+// buffer objects, at most upload_budget bytes per frame, so a large image
+// is spread over several frames instead of stalling one of them. A ring
+// buffer is reused only after a fence says the GPU has finished reading it.
+struct texture_streamer
+{
+    using handle = std::uint32_t;
+
+    // The upload budget must fit at least one row of the widest image
+    texture_streamer(thread_pool & pool, std::size_t upload_budget = 4 << 20, std::size_t ring_size = 3);
+
+    // Starts loading the file; requesting the same file again returns the same handle
+    handle request(std::filesystem::path const & path);
+
+    // The loaded texture, or the placeholder while it is still loading
+    GLuint texture(handle h) const { return textures_[h]; }
+
+    bool loaded(handle h) const { return textures_[h] != placeholder_; }
+
+    // Number of requested textures not loaded yet
+    std::size_t pending() const { return decoder_.pending() + uploads_.size(); }
+
+    // Uploads the next part of the decoded images, should be called once per frame
+    void update();
+
+private:
+    struct upload
+    {
+        handle target;
+        GLuint texture;
+        decoded_image image;
+        int next_row = 0;
+    };
+
+    struct staging_buffer
+    {
+        GLuint buffer;
+        GLsync fence = nullptr;
+    };
+
+    texture_decoder decoder_;
+    std::size_t upload_budget_;
+
+    GLuint placeholder_;
+    std::vector<GLuint> textures_;
+    std::map<std::string, handle> handles_;
+
+    std::deque<upload> uploads_;
+    std::vector<staging_buffer> ring_;
+    std::size_t ring_index_ = 0;
+};
@@ -0,0 +1,77 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <latch>
+
+thread_pool::thread_pool(std::size_t thread_count)
+{
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for (std::size_t i = 0; i < thread_count; ++i)
+        threads_.emplace_back([this]{ work(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard lock{mutex_};
+        stopped_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto & thread : threads_)
+        thread.join();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard lock{mutex_};
+        tasks_.push(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void thread_pool::parallel_for(std::size_t count, std::size_t chunk_size, std::function<void(std::size_t, std::size_t)> const & f)
+{
+    if (count == 0)
+        return;
+
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    std::size_t const chunk_count = (count + chunk_size - 1) / chunk_size;
+    std::size_t const helper_count = std::min(chunk_count - 1, threads_.size());
+
+    // Chunks are grabbed dynamically, so uneven chunks don't stall the rest
+    std::atomic<std::size_t> next_chunk{0};
+    auto run = [&]
+    {
+        for (std::size_t chunk; (chunk = next_chunk.fetch_add(1)) < chunk_count;)
+            f(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+    };
+
+    std::latch done(helper_count);
+    for (std::size_t i = 0; i < helper_count; ++i)
+        submit([&]{ run(); done.count_down(); });
+
+    run();
+    done.wait();
+}
+
+void thread_pool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock lock{mutex_};
+            condition_.wait(lock, [this]{ return stopped_ || !tasks_.empty(); });
+            if (stopped_ && tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,207 @@
+#include "vertex_animation_texture.hpp"
+#include "animation.hpp"
+#include "cpu_skinning.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <glm/gtc/packing.hpp>
+
+vertex_animation_texture bake_vertex_animation_texture(gltf_model const & model, std::vector<std::string> const & animation_names,
+    vertex_animation_texture::content_type content, float frame_rate, bool half_float, std::uint32_t width, thread_pool * pool)
+{
+    vertex_animation_texture result;
+    result.content = content;
+    result.half_float = half_float;
+    result.frame_rate = frame_rate;
+    result.width = width;
+
+    std::uint32_t vertex_count = 0;
+    for (auto const & mesh : model.meshes)
+    {
+        result.mesh_vertex_offsets.push_back(vertex_count);
+        vertex_count += mesh.position.count;
+    }
+
+    if (content == vertex_animation_texture::content_type::bone_matrices)
+        result.texels_per_frame = 3 * model.bones.size();
+    else
+        result.texels_per_frame = 2 * vertex_count;
+
+    std::uint32_t frame_count = 0;
+    for (auto const & name : animation_names)
+    {
+        auto & clip = result.clips.emplace_back();
+        clip.name = name;
+        clip.first_frame = frame_count;
+        // Clips loop, so the last frame is the first one again and isn't stored
+        clip.frame_count = std::max<std::uint32_t>(1, std::round(loop_duration(model.animations.at(name)) * frame_rate));
+        frame_count += clip.frame_count;
+    }
+
+    std::size_t const texel_count = std::size_t(frame_count) * result.texels_per_frame;
+    result.height = (texel_count + width - 1) / width;
+
+    std::vector<float> data(std::size_t(result.width) * result.height * 4, 0.f);
+
+    auto bake_frame = [&](std::size_t clip_index, std::uint32_t frame)
+    {
+        auto const & clip = result.clips[clip_index];
+        auto const & animation = model.animations.at(clip.name);
+        float const time = frame / frame_rate;
+
+        float * texels = data.data() + std::size_t(clip.first_frame + frame) * result.texels_per_frame * 4;
+
+        std::vector<bone_transform> palette(model.bones.size());
+        compute_bone_palette(model, animation, time, palette);
+
+        if (content == vertex_animation_texture::content_type::bone_matrices)
+        {
+            std::memcpy(texels, palette.data(), palette.size() * sizeof(palette[0]));
+            return;
+        }
+
+        skinned_vertices vertices;
+        for (std::size_t m = 0; m < model.meshes.size(); ++m)
+        {
+            skin_vertices(model, model.meshes[m], palette, vertices);
+
+            float * mesh_texels = texels + std::size_t(result.mesh_vertex_offsets[m]) * 2 * 4;
+            for (std::size_t v = 0; v < vertices.positions.size(); ++v)
+            {
+                std::memcpy(mesh_texels + v * 8 + 0, &vertices.positions[v], sizeof(glm::vec3));
+                std::memcpy(mesh_texels + v * 8 + 4, &vertices.normals[v], sizeof(glm::vec3));
+            }
+        }
+    };
+
+    std::vector<std::pair<std::size_t, std::uint32_t>> frames;
+    for (std::size_t c = 0; c < result.clips.size(); ++c)
+        for (std::uint32_t f = 0; f < result.clips[c].frame_count; ++f)
+            frames.emplace_back(c, f);
+
+    auto bake_frames = [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            bake_frame(frames[i].first, frames[i].second);
+    };
+
+    if (pool)
+        pool->parallel_for(frames.size(), 4, bake_frames);
+    else
+        bake_frames(0, frames.size());
+
+    if (half_float)
+    {
+        result.half_data.resize(data.size());
+        for (std::size_t i = 0; i < data.size(); ++i)
+            result.half_data[i] = glm::packHalf1x16(data[i]);
+    }
+    else
+        result.data = std::move(data);
+
+    return result;
+}
+
+namespace
+{
+
+    constexpr char vat_magic[4] = {'V', 'A', 'T', '0'};
+
+    template <typename T>
+    void write(std::ostream & output, T const & value)
+    {
+        output.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void write(std::ostream & output, std::vector<T> const & values)
+    {
+        write(output, static_cast<std::uint64_t>(values.size()));
+        output.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    T read(std::istream & input)
+    {
+        T value;
+        input.read(reinterpret_cast<char *>(&value), sizeof(value));
+        return value;
+    }
+
+    template <typename T>
+    void read(std::istream & input, std::vector<T> & values)
+    {
+        values.resize(read<std::uint64_t>(input));
+        input.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+    }
+
+}
+
+void save_vertex_animation_texture(vertex_animation_texture const & texture, std::filesystem::path const & path)
+{
+    std::ofstream output(path, std::ios::binary);
+    if (!output)
+        throw std::runtime_error("Failed to open " + path.string() + " for writing");
+
+    output.write(vat_magic, sizeof(vat_magic));
+    write(output, texture.content);
+    write(output, static_cast<std::uint32_t>(texture.half_float));
+    write(output, texture.frame_rate);
+    write(output, texture.width);
+    write(output, texture.height);
+    write(output, texture.texels_per_frame);
+
+    write(output, static_cast<std::uint64_t>(texture.clips.size()));
+    for (auto const & clip : texture.clips)
+    {
+        write(output, std::vector<char>(clip.name.begin(), clip.name.end()));
+        write(output, clip.first_frame);
+        write(output, clip.frame_count);
+    }
+
+    write(output, texture.mesh_vertex_offsets);
+    write(output, texture.data);
+    write(output, texture.half_data);
+}
+
+vertex_animation_texture load_vertex_animation_texture(std::filesystem::path const & path)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    char magic[4];
+    input.read(magic, sizeof(magic));
+    if (std::memcmp(magic, vat_magic, sizeof(magic)) != 0)
+        throw std::runtime_error("Not a vertex animation texture: " + path.string());
+
+    vertex_animation_texture result;
+    result.content = read<vertex_animation_texture::content_type>(input);
+    result.half_float = read<std::uint32_t>(input) != 0;
+    result.frame_rate = read<float>(input);
+    result.width = read<std::uint32_t>(input);
+    result.height = read<std::uint32_t>(input);
+    result.texels_per_frame = read<std::uint32_t>(input);
+
+    result.clips.resize(read<std::uint64_t>(input));
+    for (auto & clip : result.clips)
+    {
+        std::vector<char> name;
+        read(input, name);
+        clip.name.assign(name.begin(), name.end());
+        clip.first_frame = read<std::uint32_t>(input);
+        clip.frame_count = read<std::uint32_t>(input);
+    }
+
+    read(input, result.mesh_vertex_offsets);
+    read(input, result.data);
+    read(input, result.half_data);
+
+    if (!input)
+        throw std::runtime_error("Truncated vertex animation texture: " + path.string());
+
+    return result;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Every frame of every animation clip baked into an RGBA texture, so that
+// instances can be animated in the vertex shader without any pose
+// evaluation on the CPU.
+//
+// Frames are stored one after another, each frame taking texels_per_frame
+// consecutive texels in row-major order (a frame may span several rows).
+// A frame holds either the skinning palette (3 texels per bone, the rows of
+// the bone transform) or the skinned vertices of all meshes (2 texels per
+// vertex: position and normal).
+struct vertex_animation_texture
+{
+    enum class content_type : std::uint32_t
+    {
+        bone_matrices,
+        vertices,
+    };
+
+    struct clip
+    {
+        std::string name;
+        std::uint32_t first_frame;
+        std::uint32_t frame_count;
+    };
+
+    content_type content;
+    bool half_float;
+    float frame_rate;
+
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t texels_per_frame;
+
+    std::vector<clip> clips;
+
+    // For vertex content, the first vertex of each mesh within a frame
+    std::vector<std::uint32_t> mesh_vertex_offsets;
+
+    // RGBA texels, either floats or half floats
+    std::vector<float> data;
+    std::vector<std::uint16_t> half_data;
+};
+
+vertex_animation_texture bake_vertex_animation_texture(gltf_model const & model, std::vector<std::string> const & animation_names,
+    vertex_animation_texture::content_type content, float frame_rate, bool half_float, std::uint32_t width = 2048, thread_pool * pool = nullptr);
+
+// Offline baking: the result can be stored and loaded instead of being baked at startup
+void save_vertex_animation_texture(vertex_animation_texture const & texture, std::filesystem::path const & path);
+vertex_animation_texture load_vertex_animation_texture(std::filesystem::path const & path);
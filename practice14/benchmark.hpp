@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+
+// Average time of one call of f in seconds, for the headless benchmarks.
+// Runs for at least half a second to get a stable number
+template <typename F>
+double measure(F && f)
+{
+	int iterations = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed{0.0};
+	while (elapsed.count() < 0.5)
+	{
+		f();
+		++iterations;
+		elapsed = std::chrono::high_resolution_clock::now() - start;
+	}
+	return elapsed.count() / iterations;
+}
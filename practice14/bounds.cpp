@@ -0,0 +1,166 @@
+#include "bounds.hpp"
+
+#include <glm/mat3x3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+obb::obb(glm::vec3 const & center, std::array<glm::vec3, 3> const & half_axes)
+	: center(center)
+	, half_axes(half_axes)
+{
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		vertices[i] = center
+			+ ((i & 1) ? half_axes[0] : -half_axes[0])
+			+ ((i & 2) ? half_axes[1] : -half_axes[1])
+			+ ((i & 4) ? half_axes[2] : -half_axes[2]);
+	}
+
+	face_normals = {
+		glm::cross(half_axes[1], half_axes[2]),
+		glm::cross(half_axes[2], half_axes[0]),
+		glm::cross(half_axes[0], half_axes[1]),
+	};
+
+	edge_directions = half_axes;
+}
+
+// Eigenvectors of a symmetric matrix, as the columns of the result, by
+// cyclic Jacobi rotations that zero one off-diagonal element at a time
+static glm::mat3 eigenvectors(glm::mat3 a)
+{
+	glm::mat3 v(1.f);
+
+	for (int sweep = 0; sweep < 32; ++sweep)
+	{
+		float const off_diagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		float const diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+		if (off_diagonal <= 1e-12f * diagonal)
+			break;
+
+		for (auto [p, q] : {std::pair{0, 1}, std::pair{0, 2}, std::pair{1, 2}})
+		{
+			if (a[p][q] == 0.f)
+				continue;
+
+			float const theta = (a[q][q] - a[p][p]) / (2.f * a[p][q]);
+			float const t = (theta >= 0.f ? 1.f : -1.f) / (std::abs(theta) + std::sqrt(theta * theta + 1.f));
+			float const c = 1.f / std::sqrt(t * t + 1.f);
+			float const s = t * c;
+
+			glm::mat3 rotation(1.f);
+			rotation[p][p] = c;
+			rotation[q][q] = c;
+			rotation[q][p] = s;
+			rotation[p][q] = -s;
+
+			a = glm::transpose(rotation) * a * rotation;
+			v = v * rotation;
+		}
+	}
+
+	return v;
+}
+
+// The box along the axes that contains all the points
+static obb fit_along(std::span<glm::vec3 const> points, glm::mat3 const & axes)
+{
+	glm::vec3 min(std::numeric_limits<float>::infinity());
+	glm::vec3 max(-std::numeric_limits<float>::infinity());
+
+	for (auto const & p : points)
+	{
+		glm::vec3 const local(glm::dot(p, axes[0]), glm::dot(p, axes[1]), glm::dot(p, axes[2]));
+		min = glm::min(min, local);
+		max = glm::max(max, local);
+	}
+
+	glm::vec3 const center = (min + max) * 0.5f;
+	glm::vec3 const half_size = (max - min) * 0.5f;
+
+	return obb(axes * center, {axes[0] * half_size.x, axes[1] * half_size.y, axes[2] * half_size.z});
+}
+
+static float volume(obb const & box)
+{
+	return glm::length(box.half_axes[0]) * glm::length(box.half_axes[1]) * glm::length(box.half_axes[2]);
+}
+
+obb fit_obb(std::span<glm::vec3 const> points)
+{
+	if (points.empty())
+		return obb(glm::vec3(0.f), {glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f)});
+
+	glm::vec3 mean(0.f);
+	for (auto const & p : points)
+		mean += p;
+	mean /= float(points.size());
+
+	glm::mat3 covariance(0.f);
+	for (auto const & p : points)
+	{
+		glm::vec3 const d = p - mean;
+		for (int i = 0; i < 3; ++i)
+			for (int j = 0; j < 3; ++j)
+				covariance[i][j] += d[i] * d[j];
+	}
+
+	glm::mat3 axes = eigenvectors(covariance);
+	for (int i = 0; i < 3; ++i)
+		axes[i] = glm::normalize(axes[i]);
+
+	obb const principal = fit_along(points, axes);
+	obb const aligned = fit_along(points, glm::mat3(1.f));
+
+	return volume(principal) < volume(aligned) ? principal : aligned;
+}
+
+bounding_sphere fit_sphere(std::span<glm::vec3 const> points)
+{
+	if (points.empty())
+		return {};
+
+	auto farthest = [&](glm::vec3 const & from)
+	{
+		return *std::max_element(points.begin(), points.end(), [&](glm::vec3 const & a, glm::vec3 const & b)
+		{
+			return glm::distance(a, from) < glm::distance(b, from);
+		});
+	};
+
+	glm::vec3 const y = farthest(points[0]);
+	glm::vec3 const z = farthest(y);
+
+	bounding_sphere result{(y + z) * 0.5f, glm::distance(y, z) * 0.5f};
+
+	// Every point outside moves the sphere towards it just enough to touch it
+	for (auto const & p : points)
+	{
+		float const d = glm::distance(p, result.center);
+		if (d <= result.radius)
+			continue;
+
+		float const radius = (result.radius + d) * 0.5f;
+		result.center += (p - result.center) * ((d - radius) / d);
+		result.radius = radius;
+	}
+
+	return result;
+}
+
+obb transform(glm::mat4 const & m, obb const & box)
+{
+	glm::mat3 const linear(m);
+	return obb(glm::vec3(m * glm::vec4(box.center, 1.f)), {linear * box.half_axes[0], linear * box.half_axes[1], linear * box.half_axes[2]});
+}
+
+bounding_sphere transform(glm::mat4 const & m, bounding_sphere const & sphere)
+{
+	float const scale = std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+	return {glm::vec3(m * glm::vec4(sphere.center, 1.f)), sphere.radius * scale};
+}
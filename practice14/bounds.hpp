@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <span>
+
+// Oriented box given by its center and three half axes, which needn't be
+// orthogonal: a non-uniformly scaled box becomes a parallelepiped, which
+// the separating axis test handles the same way
+struct obb
+{
+	obb(glm::vec3 const & center, std::array<glm::vec3, 3> const & half_axes);
+
+	glm::vec3 center;
+	std::array<glm::vec3, 3> half_axes;
+
+	std::array<glm::vec3, 8> vertices;
+	std::array<glm::vec3, 3> face_normals;
+	std::array<glm::vec3, 3> edge_directions;
+};
+
+struct bounding_sphere
+{
+	glm::vec3 center{0.f};
+	float radius = 0.f;
+};
+
+// Box along the principal axes of the points, the directions of largest
+// and smallest spread. The axes come from the covariance of the points,
+// which is biased towards densely tessellated regions, so the axis-aligned
+// box is returned instead if it is smaller
+obb fit_obb(std::span<glm::vec3 const> points);
+
+// Ritter's sphere: starts from two far apart points and grows to include
+// the rest, typically within 5-20% of the minimal radius in one pass
+bounding_sphere fit_sphere(std::span<glm::vec3 const> points);
+
+obb transform(glm::mat4 const & m, obb const & box);
+
+// The radius is scaled by the largest scale of the matrix
+bounding_sphere transform(glm::mat4 const & m, bounding_sphere const & sphere);
@@ -0,0 +1,299 @@
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+static constexpr float inf = std::numeric_limits<float>::infinity();
+
+static float half_area(glm::vec3 const & min, glm::vec3 const & max)
+{
+	glm::vec3 const d = glm::max(max - min, glm::vec3(0.f));
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+bvh::bvh(box_set const & boxes)
+{
+	std::uint32_t const count = boxes.size();
+
+	object_min.resize(count);
+	object_max.resize(count);
+	objects.resize(count);
+	leaf_of_.resize(count);
+
+	std::vector<glm::vec3> centroid(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		object_min[i] = boxes.min(i);
+		object_max[i] = boxes.max(i);
+		centroid[i] = (object_min[i] + object_max[i]) * 0.5f;
+		objects[i] = i;
+	}
+
+	if (count == 0)
+		return;
+
+	nodes.push_back({glm::vec3(inf), 0, glm::vec3(-inf), 0, count});
+	parent_.push_back(0);
+
+	static constexpr int bin_count = 16;
+
+	struct bin
+	{
+		glm::vec3 min{inf};
+		glm::vec3 max{-inf};
+		std::uint32_t count = 0;
+	};
+
+	// Nodes are split with an explicit stack, so that degenerate inputs
+	// don't overflow the call stack
+	std::vector<std::uint32_t> stack{0};
+	while (!stack.empty())
+	{
+		std::uint32_t const index = stack.back();
+		stack.pop_back();
+
+		std::uint32_t const first = nodes[index].first;
+		std::uint32_t const node_count = nodes[index].count;
+
+		glm::vec3 min(inf), max(-inf), centroid_min(inf), centroid_max(-inf);
+		for (std::uint32_t i = first; i < first + node_count; ++i)
+		{
+			std::uint32_t const object = objects[i];
+			min = glm::min(min, object_min[object]);
+			max = glm::max(max, object_max[object]);
+			centroid_min = glm::min(centroid_min, centroid[object]);
+			centroid_max = glm::max(centroid_max, centroid[object]);
+		}
+
+		nodes[index].min = min;
+		nodes[index].max = max;
+
+		auto make_leaf = [&]
+		{
+			for (std::uint32_t i = first; i < first + node_count; ++i)
+				leaf_of_[objects[i]] = index;
+		};
+
+		if (node_count <= max_leaf_size)
+		{
+			make_leaf();
+			continue;
+		}
+
+		// The cheapest split between bins along any axis, costs are in units
+		// of the node area times the object count
+		float best_cost = inf;
+		int best_axis = -1;
+		int best_split = 0;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float const extent = centroid_max[axis] - centroid_min[axis];
+			if (extent <= 0.f) continue;
+
+			float const scale = bin_count / extent;
+			auto bin_index = [&](std::uint32_t object)
+			{
+				return std::min(bin_count - 1, static_cast<int>((centroid[object][axis] - centroid_min[axis]) * scale));
+			};
+
+			std::array<bin, bin_count> bins;
+			for (std::uint32_t i = first; i < first + node_count; ++i)
+			{
+				std::uint32_t const object = objects[i];
+				auto & b = bins[bin_index(object)];
+				b.min = glm::min(b.min, object_min[object]);
+				b.max = glm::max(b.max, object_max[object]);
+				++b.count;
+			}
+
+			// Sweep from the right to get the costs of all right halves, then
+			// from the left to combine them
+			std::array<float, bin_count> right_cost;
+			bin right;
+			for (int i = bin_count - 1; i > 0; --i)
+			{
+				right.min = glm::min(right.min, bins[i].min);
+				right.max = glm::max(right.max, bins[i].max);
+				right.count += bins[i].count;
+				right_cost[i] = right.count ? half_area(right.min, right.max) * right.count : 0.f;
+			}
+
+			bin left;
+			for (int split = 1; split < bin_count; ++split)
+			{
+				left.min = glm::min(left.min, bins[split - 1].min);
+				left.max = glm::max(left.max, bins[split - 1].max);
+				left.count += bins[split - 1].count;
+
+				if (left.count == 0 || left.count == node_count) continue;
+
+				float const cost = half_area(left.min, left.max) * left.count + right_cost[split];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_split = split;
+				}
+			}
+		}
+
+		std::uint32_t middle;
+		if (best_axis >= 0)
+		{
+			// Splitting isn't worth it when the children together cost more
+			// than testing every object of a small node
+			if (node_count <= 4 * max_leaf_size && best_cost >= half_area(min, max) * node_count)
+			{
+				make_leaf();
+				continue;
+			}
+
+			float const scale = bin_count / (centroid_max[best_axis] - centroid_min[best_axis]);
+			auto const split = std::partition(objects.begin() + first, objects.begin() + first + node_count, [&](std::uint32_t object)
+			{
+				return std::min(bin_count - 1, static_cast<int>((centroid[object][best_axis] - centroid_min[best_axis]) * scale)) < best_split;
+			});
+			middle = split - objects.begin();
+		}
+		else
+		{
+			// All centroids coincide, any split is as good as another
+			middle = first + node_count / 2;
+		}
+
+		std::uint32_t const left = nodes.size();
+		nodes[index].left = left;
+		nodes.push_back({glm::vec3(inf), 0, glm::vec3(-inf), first, middle - first});
+		nodes.push_back({glm::vec3(inf), 0, glm::vec3(-inf), middle, first + node_count - middle});
+		parent_.push_back(index);
+		parent_.push_back(index);
+
+		stack.push_back(left + 1);
+		stack.push_back(left);
+	}
+}
+
+void bvh::fit(std::uint32_t index)
+{
+	auto & n = nodes[index];
+	if (n.left == 0)
+	{
+		n.min = glm::vec3(inf);
+		n.max = glm::vec3(-inf);
+		for (std::uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			n.min = glm::min(n.min, object_min[objects[i]]);
+			n.max = glm::max(n.max, object_max[objects[i]]);
+		}
+	}
+	else
+	{
+		n.min = glm::min(nodes[n.left].min, nodes[n.left + 1].min);
+		n.max = glm::max(nodes[n.left].max, nodes[n.left + 1].max);
+	}
+}
+
+void bvh::update(std::uint32_t object, glm::vec3 const & min, glm::vec3 const & max)
+{
+	if (object_min[object] == min && object_max[object] == max)
+		return;
+
+	object_min[object] = min;
+	object_max[object] = max;
+
+	for (std::uint32_t index = leaf_of_[object];; index = parent_[index])
+	{
+		glm::vec3 const old_min = nodes[index].min;
+		glm::vec3 const old_max = nodes[index].max;
+
+		fit(index);
+
+		if (index == 0 || (nodes[index].min == old_min && nodes[index].max == old_max))
+			break;
+	}
+}
+
+void bvh::refit()
+{
+	// Children are always stored after their parents
+	for (std::uint32_t index = nodes.size(); index-- > 0;)
+		fit(index);
+}
+
+void bvh::cull(frustum_planes const & planes, std::vector<std::uint32_t> & visible) const
+{
+	if (nodes.empty())
+		return;
+
+	static constexpr std::uint32_t all_planes = (1 << 6) - 1;
+
+	// Tests the box against the planes in the mask; returns the planes that
+	// still intersect it, or nothing if the box is behind one of them
+	auto test = [&](glm::vec3 const & min, glm::vec3 const & max, std::uint32_t mask) -> std::optional<std::uint32_t>
+	{
+		glm::vec3 const center = (min + max) * 0.5f;
+		glm::vec3 const extent = (max - min) * 0.5f;
+
+		for (int p = 0; p < 6; ++p)
+		{
+			if (!(mask & (1 << p))) continue;
+
+			auto const & plane = planes.planes[p];
+			float const distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float const radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+
+			if (distance + radius < 0.f)
+				return std::nullopt;
+			if (distance - radius >= 0.f)
+				mask &= ~(1u << p);
+		}
+
+		return mask;
+	};
+
+	struct entry
+	{
+		std::uint32_t node;
+		std::uint32_t mask;
+	};
+
+	std::vector<entry> stack{{0, all_planes}};
+	while (!stack.empty())
+	{
+		auto const [index, parent_mask] = stack.back();
+		stack.pop_back();
+
+		auto const & n = nodes[index];
+
+		auto const mask = test(n.min, n.max, parent_mask);
+		if (!mask) continue;
+
+		// Entirely inside: no need to look at anything below
+		if (*mask == 0)
+		{
+			visible.insert(visible.end(), objects.begin() + n.first, objects.begin() + n.first + n.count);
+			continue;
+		}
+
+		if (n.left != 0)
+		{
+			stack.push_back({n.left + 1, *mask});
+			stack.push_back({n.left, *mask});
+			continue;
+		}
+
+		for (std::uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			std::uint32_t const object = objects[i];
+			if (test(object_min[object], object_max[object], *mask))
+				visible.push_back(object);
+		}
+	}
+}
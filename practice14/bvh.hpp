@@ -0,0 +1,62 @@
+#pragma once
+
+#include "culling.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A bounding volume hierarchy over object boxes, for culling scenes much
+// larger than the visible part of them.
+//
+// The tree is built top-down with the surface area heuristic over binned
+// centroids. Objects are reordered so that every node covers a contiguous
+// range of `objects`: a subtree that is entirely inside the frustum is
+// accepted as a whole without testing anything below it. Moving objects
+// are handled by refitting the boxes along the path to the root; the tree
+// itself stays the same, so after large movements it should be rebuilt.
+struct bvh
+{
+	struct node
+	{
+		glm::vec3 min;
+		// First child, the second one follows it; 0 for leaves
+		std::uint32_t left;
+		glm::vec3 max;
+		// The range of `objects` covered by the node
+		std::uint32_t first;
+		std::uint32_t count;
+	};
+
+	static constexpr std::uint32_t max_leaf_size = 4;
+
+	std::vector<node> nodes;
+	// Object indices in tree order
+	std::vector<std::uint32_t> objects;
+
+	std::vector<glm::vec3> object_min;
+	std::vector<glm::vec3> object_max;
+
+	bvh() = default;
+	explicit bvh(box_set const & boxes);
+
+	std::size_t size() const { return object_min.size(); }
+
+	// Changes the box of one object and refits its ancestors, stopping at the
+	// first one whose box doesn't change
+	void update(std::uint32_t object, glm::vec3 const & min, glm::vec3 const & max);
+
+	// Refits every node, cheaper than update() once most objects have moved
+	void refit();
+
+	// Appends the indices of the objects that pass the plane tests, the same
+	// set as cull_boxes over all objects but in tree order
+	void cull(frustum_planes const & planes, std::vector<std::uint32_t> & visible) const;
+
+private:
+	std::vector<std::uint32_t> parent_;
+	std::vector<std::uint32_t> leaf_of_;
+
+	void fit(std::uint32_t node);
+};
@@ -0,0 +1,405 @@
+#include "culling.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define CULLING_AVX2
+#endif
+
+void box_set::clear()
+{
+	for (auto * v : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z})
+		v->clear();
+}
+
+void box_set::push_back(glm::vec3 const & min, glm::vec3 const & max)
+{
+	glm::vec3 const center = (min + max) * 0.5f;
+	glm::vec3 const extent = (max - min) * 0.5f;
+
+	center_x.push_back(center.x);
+	center_y.push_back(center.y);
+	center_z.push_back(center.z);
+	extent_x.push_back(extent.x);
+	extent_y.push_back(extent.y);
+	extent_z.push_back(extent.z);
+}
+
+glm::vec3 box_set::min(std::size_t i) const
+{
+	return {center_x[i] - extent_x[i], center_y[i] - extent_y[i], center_z[i] - extent_z[i]};
+}
+
+glm::vec3 box_set::max(std::size_t i) const
+{
+	return {center_x[i] + extent_x[i], center_y[i] + extent_y[i], center_z[i] + extent_z[i]};
+}
+
+void sphere_set::clear()
+{
+	for (auto * v : {&center_x, &center_y, &center_z, &radius})
+		v->clear();
+}
+
+void sphere_set::push_back(bounding_sphere const & sphere)
+{
+	center_x.push_back(sphere.center.x);
+	center_y.push_back(sphere.center.y);
+	center_z.push_back(sphere.center.z);
+	radius.push_back(sphere.radius);
+}
+
+void obb_set::clear()
+{
+	for (auto * v : {&center_x, &center_y, &center_z})
+		v->clear();
+	for (int a = 0; a < 3; ++a)
+	{
+		half_x[a].clear();
+		half_y[a].clear();
+		half_z[a].clear();
+	}
+}
+
+void obb_set::push_back(obb const & box)
+{
+	center_x.push_back(box.center.x);
+	center_y.push_back(box.center.y);
+	center_z.push_back(box.center.z);
+	for (int a = 0; a < 3; ++a)
+	{
+		half_x[a].push_back(box.half_axes[a].x);
+		half_y[a].push_back(box.half_axes[a].y);
+		half_z[a].push_back(box.half_axes[a].z);
+	}
+}
+
+obb obb_set::operator[](std::size_t i) const
+{
+	return obb({center_x[i], center_y[i], center_z[i]}, {
+		glm::vec3(half_x[0][i], half_y[0][i], half_z[0][i]),
+		glm::vec3(half_x[1][i], half_y[1][i], half_z[1][i]),
+		glm::vec3(half_x[2][i], half_y[2][i], half_z[2][i]),
+	});
+}
+
+frustum_planes::frustum_planes(glm::mat4 const & view_projection)
+{
+	// A point is inside when -w <= x, y, z <= w in clip space; every
+	// inequality is a plane made of two rows of the matrix
+	auto row = [&](int i)
+	{
+		return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	};
+
+	for (int i = 0; i < 3; ++i)
+	{
+		planes[2 * i + 0] = row(3) + row(i);
+		planes[2 * i + 1] = row(3) - row(i);
+	}
+
+	for (auto & plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+std::pair<glm::vec3, glm::vec3> transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max)
+{
+	// Every column of the matrix moves the box by the smaller or the larger
+	// of its two contributions
+	glm::vec3 result_min = transform[3];
+	glm::vec3 result_max = transform[3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		glm::vec3 const a = glm::vec3(transform[i]) * min[i];
+		glm::vec3 const b = glm::vec3(transform[i]) * max[i];
+		result_min += glm::min(a, b);
+		result_max += glm::max(a, b);
+	}
+
+	return {result_min, result_max};
+}
+
+// A box is behind a plane when its center is further behind it than the
+// projection of the extents onto the plane normal
+static bool box_visible(frustum_planes const & planes, box_set const & boxes, std::size_t i)
+{
+	for (auto const & p : planes.planes)
+	{
+		float const distance = p.x * boxes.center_x[i] + p.y * boxes.center_y[i] + p.z * boxes.center_z[i] + p.w;
+		float const radius = std::abs(p.x) * boxes.extent_x[i] + std::abs(p.y) * boxes.extent_y[i] + std::abs(p.z) * boxes.extent_z[i];
+		if (distance + radius < 0.f)
+			return false;
+	}
+	return true;
+}
+
+void cull_boxes_reference(frustum_planes const & planes, box_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	for (std::uint32_t i = 0; i < boxes.size(); ++i)
+		if (box_visible(planes, boxes, i))
+			visible.push_back(i);
+}
+
+static bool sphere_visible(frustum_planes const & planes, sphere_set const & spheres, std::size_t i)
+{
+	for (auto const & p : planes.planes)
+	{
+		float const distance = p.x * spheres.center_x[i] + p.y * spheres.center_y[i] + p.z * spheres.center_z[i] + p.w;
+		if (distance + spheres.radius[i] < 0.f)
+			return false;
+	}
+	return true;
+}
+
+void cull_spheres_reference(frustum_planes const & planes, sphere_set const & spheres, std::vector<std::uint32_t> & visible)
+{
+	for (std::uint32_t i = 0; i < spheres.size(); ++i)
+		if (sphere_visible(planes, spheres, i))
+			visible.push_back(i);
+}
+
+// Same as for the axis-aligned boxes, with every half axis contributing
+// the absolute value of its projection onto the normal
+static bool obb_visible(frustum_planes const & planes, obb_set const & boxes, std::size_t i)
+{
+	for (auto const & p : planes.planes)
+	{
+		float distance = p.x * boxes.center_x[i] + p.y * boxes.center_y[i] + p.z * boxes.center_z[i] + p.w;
+		for (int a = 0; a < 3; ++a)
+			distance += std::abs(p.x * boxes.half_x[a][i] + p.y * boxes.half_y[a][i] + p.z * boxes.half_z[a][i]);
+		if (distance < 0.f)
+			return false;
+	}
+	return true;
+}
+
+void cull_obbs_reference(frustum_planes const & planes, obb_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	for (std::uint32_t i = 0; i < boxes.size(); ++i)
+		if (obb_visible(planes, boxes, i))
+			visible.push_back(i);
+}
+
+#ifdef CULLING_AVX2
+
+// For every 8-bit mask, the positions of its set bits packed to the front,
+// used to store the indices of the visible boxes without branches
+static auto const compress_table = []
+{
+	std::array<std::array<std::uint32_t, 8>, 256> result{};
+	for (int mask = 0; mask < 256; ++mask)
+	{
+		int count = 0;
+		for (int bit = 0; bit < 8; ++bit)
+			if (mask & (1 << bit))
+				result[mask][count++] = bit;
+	}
+	return result;
+}();
+
+// Runs the kernel on groups of eight objects, which returns the sign bits
+// set for the objects outside, and appends the indices of the rest. The
+// objects that don't fill a group go through the scalar test
+template <typename Kernel, typename Scalar>
+static void cull_simd(std::size_t count, std::vector<std::uint32_t> & visible, Kernel && outside, Scalar && scalar_visible)
+{
+	std::size_t const simd_count = count & ~std::size_t(7);
+
+	// Every group of eight stores eight indices and then advances by the
+	// number of visible ones, so there has to be room for a full group
+	std::size_t size = visible.size();
+	visible.resize(size + simd_count + 8);
+
+	__m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i const step = _mm256_set1_epi32(8);
+
+	for (std::size_t i = 0; i < simd_count; i += 8)
+	{
+		int const mask = ~_mm256_movemask_ps(outside(i)) & 0xff;
+
+		__m256i const permutation = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(compress_table[mask].data()));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(visible.data() + size), _mm256_permutevar8x32_epi32(index, permutation));
+		size += std::popcount(static_cast<unsigned int>(mask));
+
+		index = _mm256_add_epi32(index, step);
+	}
+
+	visible.resize(size);
+
+	for (std::size_t i = simd_count; i < count; ++i)
+		if (scalar_visible(i))
+			visible.push_back(i);
+}
+
+// The planes broadcast to all lanes
+struct simd_planes
+{
+	__m256 normal[6][3], abs_normal[6][3], offset[6];
+
+	explicit simd_planes(frustum_planes const & planes)
+	{
+		__m256 const sign_mask = _mm256_set1_ps(-0.f);
+		for (int p = 0; p < 6; ++p)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				normal[p][c] = _mm256_set1_ps(planes.planes[p][c]);
+				abs_normal[p][c] = _mm256_andnot_ps(sign_mask, normal[p][c]);
+			}
+			offset[p] = _mm256_set1_ps(planes.planes[p].w);
+		}
+	}
+
+	__m256 distance(int p, __m256 x, __m256 y, __m256 z) const
+	{
+		__m256 result = _mm256_fmadd_ps(normal[p][0], x, offset[p]);
+		result = _mm256_fmadd_ps(normal[p][1], y, result);
+		return _mm256_fmadd_ps(normal[p][2], z, result);
+	}
+};
+
+void cull_boxes(frustum_planes const & planes, box_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	simd_planes const simd(planes);
+
+	auto outside = [&](std::size_t i)
+	{
+		__m256 const cx = _mm256_loadu_ps(boxes.center_x.data() + i);
+		__m256 const cy = _mm256_loadu_ps(boxes.center_y.data() + i);
+		__m256 const cz = _mm256_loadu_ps(boxes.center_z.data() + i);
+		__m256 const ex = _mm256_loadu_ps(boxes.extent_x.data() + i);
+		__m256 const ey = _mm256_loadu_ps(boxes.extent_y.data() + i);
+		__m256 const ez = _mm256_loadu_ps(boxes.extent_z.data() + i);
+
+		__m256 result = _mm256_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			__m256 distance = simd.distance(p, cx, cy, cz);
+			distance = _mm256_fmadd_ps(simd.abs_normal[p][0], ex, distance);
+			distance = _mm256_fmadd_ps(simd.abs_normal[p][1], ey, distance);
+			distance = _mm256_fmadd_ps(simd.abs_normal[p][2], ez, distance);
+			result = _mm256_or_ps(result, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		return result;
+	};
+
+	cull_simd(boxes.size(), visible, outside, [&](std::size_t i){ return box_visible(planes, boxes, i); });
+}
+
+void cull_spheres(frustum_planes const & planes, sphere_set const & spheres, std::vector<std::uint32_t> & visible)
+{
+	simd_planes const simd(planes);
+
+	auto outside = [&](std::size_t i)
+	{
+		__m256 const cx = _mm256_loadu_ps(spheres.center_x.data() + i);
+		__m256 const cy = _mm256_loadu_ps(spheres.center_y.data() + i);
+		__m256 const cz = _mm256_loadu_ps(spheres.center_z.data() + i);
+		__m256 const r = _mm256_loadu_ps(spheres.radius.data() + i);
+
+		__m256 result = _mm256_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			__m256 const distance = _mm256_add_ps(simd.distance(p, cx, cy, cz), r);
+			result = _mm256_or_ps(result, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		return result;
+	};
+
+	cull_simd(spheres.size(), visible, outside, [&](std::size_t i){ return sphere_visible(planes, spheres, i); });
+}
+
+void cull_obbs(frustum_planes const & planes, obb_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	simd_planes const simd(planes);
+	__m256 const sign_mask = _mm256_set1_ps(-0.f);
+
+	auto outside = [&](std::size_t i)
+	{
+		__m256 const cx = _mm256_loadu_ps(boxes.center_x.data() + i);
+		__m256 const cy = _mm256_loadu_ps(boxes.center_y.data() + i);
+		__m256 const cz = _mm256_loadu_ps(boxes.center_z.data() + i);
+
+		__m256 hx[3], hy[3], hz[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			hx[a] = _mm256_loadu_ps(boxes.half_x[a].data() + i);
+			hy[a] = _mm256_loadu_ps(boxes.half_y[a].data() + i);
+			hz[a] = _mm256_loadu_ps(boxes.half_z[a].data() + i);
+		}
+
+		__m256 result = _mm256_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			__m256 distance = simd.distance(p, cx, cy, cz);
+			for (int a = 0; a < 3; ++a)
+			{
+				__m256 projection = _mm256_mul_ps(simd.normal[p][0], hx[a]);
+				projection = _mm256_fmadd_ps(simd.normal[p][1], hy[a], projection);
+				projection = _mm256_fmadd_ps(simd.normal[p][2], hz[a], projection);
+				distance = _mm256_add_ps(distance, _mm256_andnot_ps(sign_mask, projection));
+			}
+			result = _mm256_or_ps(result, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		return result;
+	};
+
+	cull_simd(boxes.size(), visible, outside, [&](std::size_t i){ return obb_visible(planes, boxes, i); });
+}
+
+bool cull_boxes_simd_enabled()
+{
+	return true;
+}
+
+#else
+
+void cull_boxes(frustum_planes const & planes, box_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	cull_boxes_reference(planes, boxes, visible);
+}
+
+void cull_spheres(frustum_planes const & planes, sphere_set const & spheres, std::vector<std::uint32_t> & visible)
+{
+	cull_spheres_reference(planes, spheres, visible);
+}
+
+void cull_obbs(frustum_planes const & planes, obb_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	cull_obbs_reference(planes, boxes, visible);
+}
+
+bool cull_boxes_simd_enabled()
+{
+	return false;
+}
+
+#endif
+
+void refine_visible(frustum const & view_frustum, box_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	auto outside = [&](std::uint32_t i)
+	{
+		return !intersect(aabb(boxes.min(i), boxes.max(i)), view_frustum);
+	};
+
+	visible.erase(std::remove_if(visible.begin(), visible.end(), outside), visible.end());
+}
+
+void refine_visible(frustum const & view_frustum, obb_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	auto outside = [&](std::uint32_t i)
+	{
+		return !intersect(boxes[i], view_frustum);
+	};
+
+	visible.erase(std::remove_if(visible.begin(), visible.end(), outside), visible.end());
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "frustum.hpp"
+#include "bounds.hpp"
+
+// Axis-aligned boxes stored as separate arrays of centers and half extents,
+// so that the culling kernel loads the same coordinate of eight boxes at once
+struct box_set
+{
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+
+	std::size_t size() const { return center_x.size(); }
+
+	void clear();
+	void push_back(glm::vec3 const & min, glm::vec3 const & max);
+
+	glm::vec3 min(std::size_t i) const;
+	glm::vec3 max(std::size_t i) const;
+};
+
+// Bounding spheres in the same layout
+struct sphere_set
+{
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> radius;
+
+	std::size_t size() const { return center_x.size(); }
+
+	void clear();
+	void push_back(bounding_sphere const & sphere);
+};
+
+// Oriented boxes in the same layout, half_x[a] is the x coordinate of the
+// half axis a
+struct obb_set
+{
+	std::vector<float> center_x, center_y, center_z;
+	std::array<std::vector<float>, 3> half_x, half_y, half_z;
+
+	std::size_t size() const { return center_x.size(); }
+
+	void clear();
+	void push_back(obb const & box);
+
+	obb operator[](std::size_t i) const;
+};
+
+// The six frustum planes as (normal, distance), normalized, with the normals
+// pointing inside
+struct frustum_planes
+{
+	std::array<glm::vec4, 6> planes;
+
+	explicit frustum_planes(glm::mat4 const & view_projection);
+};
+
+// Bounds of the transformed box
+std::pair<glm::vec3, glm::vec3> transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max);
+
+// Appends the indices of the boxes that are not entirely behind one of the
+// planes, in increasing order. This is conservative: a box near a frustum
+// corner can be outside of the frustum and still pass all six planes
+void cull_boxes(frustum_planes const & planes, box_set const & boxes, std::vector<std::uint32_t> & visible);
+
+// Same result as cull_boxes, one box at a time
+void cull_boxes_reference(frustum_planes const & planes, box_set const & boxes, std::vector<std::uint32_t> & visible);
+
+// Same as cull_boxes for the other bounding volumes
+void cull_spheres(frustum_planes const & planes, sphere_set const & spheres, std::vector<std::uint32_t> & visible);
+void cull_spheres_reference(frustum_planes const & planes, sphere_set const & spheres, std::vector<std::uint32_t> & visible);
+void cull_obbs(frustum_planes const & planes, obb_set const & boxes, std::vector<std::uint32_t> & visible);
+void cull_obbs_reference(frustum_planes const & planes, obb_set const & boxes, std::vector<std::uint32_t> & visible);
+
+// Removes the boxes that the exact separating axis test finds outside of the
+// frustum; meant to run on the few boxes that pass cull_boxes
+void refine_visible(frustum const & view_frustum, box_set const & boxes, std::vector<std::uint32_t> & visible);
+void refine_visible(frustum const & view_frustum, obb_set const & boxes, std::vector<std::uint32_t> & visible);
+
+bool cull_boxes_simd_enabled();
@@ -0,0 +1,266 @@
+// Headless frustum culling benchmark: culls a million random boxes with the
+// scalar and the AVX2 plane tests and with the BVH, from a camera that sees
+// much of the scene and from one that sees a small corner of it. Also
+// measures the exact separating axis refinement of the boxes that pass, with
+// and without reusing the previous frames' results for a slowly moving
+// camera and for one that pans back and forth, and the cost of keeping the
+// BVH up to date with moving objects.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "benchmark.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "culling_cache.hpp"
+#include "bounds.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+// Compares two index lists as sets
+static std::size_t count_mismatches(std::vector<std::uint32_t> a, std::vector<std::uint32_t> b)
+{
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+
+    std::vector<std::uint32_t> difference;
+    std::set_symmetric_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(difference));
+    return difference.size();
+}
+
+int main()
+{
+    std::mt19937 random;
+    std::uniform_real_distribution<float> position(-500.f, 500.f);
+    std::uniform_real_distribution<float> size(0.1f, 4.f);
+
+    box_set boxes;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        glm::vec3 const min{position(random), position(random) * 0.1f, position(random)};
+        boxes.push_back(min, min + glm::vec3(size(random), size(random), size(random)));
+    }
+
+    std::cout << "SIMD kernel: " << (cull_boxes_simd_enabled() ? "AVX2" : "disabled") << ", boxes: " << boxes.size() << std::endl;
+
+    bvh tree;
+    auto const build_start = std::chrono::high_resolution_clock::now();
+    tree = bvh(boxes);
+    std::chrono::duration<double> const build_time = std::chrono::high_resolution_clock::now() - build_start;
+    std::cout << "BVH build: " << build_time.count() * 1e3 << " ms, nodes: " << tree.nodes.size() << std::endl;
+
+    // A camera overlooking a large part of the scene and one that sees a
+    // small corner of it
+    struct camera
+    {
+        char const * name;
+        glm::mat4 view_projection;
+    };
+
+    camera const cameras[] = {
+        {"wide", glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 300.f) * glm::lookAt(glm::vec3(0.f, 20.f, 0.f), glm::vec3(100.f, 0.f, 50.f), glm::vec3(0.f, 1.f, 0.f))},
+        {"narrow", glm::perspective(glm::pi<float>() / 8.f, 16.f / 9.f, 0.1f, 50.f) * glm::lookAt(glm::vec3(480.f, 10.f, 480.f), glm::vec3(400.f, 0.f, 400.f), glm::vec3(0.f, 1.f, 0.f))},
+    };
+
+    std::cout << std::left << std::setw(36) << "" << std::setw(12) << "time, ms" << std::setw(16) << "Mboxes/s" << std::setw(12) << "visible" << "mismatches" << std::endl;
+
+    auto report = [&](std::string const & name, double time, std::size_t tested, std::vector<std::uint32_t> const & result, std::size_t mismatches)
+    {
+        std::cout << std::left << std::setw(36) << name << std::setw(12) << time * 1e3 << std::setw(16) << tested / time * 1e-6 << std::setw(12) << result.size() << mismatches << std::endl;
+    };
+
+    for (auto const & camera : cameras)
+    {
+        frustum_planes const planes(camera.view_projection);
+        frustum const view_frustum(camera.view_projection);
+
+        std::vector<std::uint32_t> reference, simd, hierarchical, refined;
+
+        double const reference_time = measure([&]{ reference.clear(); cull_boxes_reference(planes, boxes, reference); });
+        double const simd_time = measure([&]{ simd.clear(); cull_boxes(planes, boxes, simd); });
+        double const bvh_time = measure([&]{ hierarchical.clear(); tree.cull(planes, hierarchical); });
+        double const refine_time = measure([&]{ refined = simd; refine_visible(view_frustum, boxes, refined); });
+
+        // Rounding differs between the kernels, boxes touching a plane may
+        // end up on different sides
+        std::string const prefix = std::string(camera.name) + ", ";
+        report(prefix + "planes, reference", reference_time, boxes.size(), reference, 0);
+        report(prefix + "planes, SIMD", simd_time, boxes.size(), simd, count_mismatches(reference, simd));
+        report(prefix + "BVH", bvh_time, boxes.size(), hierarchical, count_mismatches(reference, hierarchical));
+        report(prefix + "SAT refinement of visible", refine_time, simd.size(), refined, 0);
+    }
+
+    // The exact test runs on what the planes let through, with and without
+    // reusing the previous frames' results, for a camera given by its view
+    // projection matrix at each point in time; 60 frames per second
+    auto run_camera = [&](std::string const & name, int frames, auto const & camera)
+    {
+        culling_cache cache;
+        culling_cache::stats total;
+        std::chrono::duration<double> naive_time{0.0}, cached_time{0.0};
+        std::size_t naive_axes = 0, mismatches = 0;
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            glm::mat4 const view_projection = camera(frame / 60.f);
+
+            std::vector<std::uint32_t> candidates;
+            cull_boxes(frustum_planes(view_projection), boxes, candidates);
+
+            std::vector<std::uint32_t> naive = candidates;
+            auto start = std::chrono::high_resolution_clock::now();
+            frustum const view_frustum(view_projection);
+            refine_visible(view_frustum, boxes, naive);
+            naive_time += std::chrono::high_resolution_clock::now() - start;
+
+            // What the plain test costs in axes, for comparison
+            for (std::uint32_t i : candidates)
+            {
+                std::size_t hint = -1;
+                intersect(aabb(boxes.min(i), boxes.max(i)), view_frustum, hint, naive_axes);
+            }
+
+            std::vector<std::uint32_t> cached = candidates;
+            start = std::chrono::high_resolution_clock::now();
+            auto const stats = cache.refine(frustum(view_projection), boxes, cached);
+            cached_time += std::chrono::high_resolution_clock::now() - start;
+
+            total.objects += stats.objects;
+            total.skipped += stats.skipped;
+            total.axes_tested += stats.axes_tested;
+            mismatches += count_mismatches(naive, cached);
+        }
+
+        std::cout << std::left << std::setw(36) << name + ", " + std::to_string(frames) + " frames" << std::setw(16) << "ms per frame" << std::setw(16) << "axes per box" << std::setw(12) << "skipped, %" << "mismatches" << std::endl;
+        std::cout << std::left << std::setw(36) << "SAT refinement" << std::setw(16) << naive_time.count() * 1e3 / frames << std::setw(16) << float(naive_axes) / total.objects << std::setw(12) << 0 << 0 << std::endl;
+        std::cout << std::left << std::setw(36) << "SAT refinement, temporal cache" << std::setw(16) << cached_time.count() * 1e3 / frames << std::setw(16) << total.average_axes()
+            << std::setw(12) << 100.f * total.skipped / total.objects << mismatches << std::endl;
+    };
+
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 300.f);
+
+    // Moves and turns a little every frame, like a walking player
+    run_camera("moving camera", 120, [&](float t)
+    {
+        glm::vec3 const eye(t * 2.f, 20.f, 0.f);
+        glm::vec3 const target = eye + glm::vec3(100.f * std::cos(0.1f * t), -20.f, 50.f + 100.f * std::sin(0.1f * t));
+        return projection * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f));
+    });
+
+    // Turns back and forth, so objects leave the plane test candidates for a
+    // while and come back once the frustum has moved far from where their
+    // results were cached
+    run_camera("panning camera", 240, [&](float t)
+    {
+        glm::vec3 const eye(0.f, 20.f, 0.f);
+        float const angle = 0.5f * std::sin(3.f * t);
+        glm::vec3 const target = eye + glm::vec3(100.f * std::cos(angle), -20.f, 100.f * std::sin(angle));
+        return projection * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f));
+    });
+
+    // Refitting after a fraction of the objects has moved a little
+    std::cout << std::left << std::setw(12) << "moved, %" << std::setw(20) << "update, ms" << "full refit, ms" << std::endl;
+    for (float fraction : {0.001f, 0.01f, 0.1f})
+    {
+        std::size_t const moved = boxes.size() * fraction;
+        std::uniform_int_distribution<std::uint32_t> object(0, boxes.size() - 1);
+        std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+        double const update_time = measure([&]{
+            for (std::size_t i = 0; i < moved; ++i)
+            {
+                auto const o = object(random);
+                glm::vec3 const d{offset(random), offset(random), offset(random)};
+                tree.update(o, tree.object_min[o] + d, tree.object_max[o] + d);
+            }
+        });
+
+        double const refit_time = measure([&]{
+            for (std::size_t i = 0; i < moved; ++i)
+            {
+                auto const o = object(random);
+                glm::vec3 const d{offset(random), offset(random), offset(random)};
+                tree.object_min[o] += d;
+                tree.object_max[o] += d;
+            }
+            tree.refit();
+        });
+
+        std::cout << std::left << std::setw(12) << fraction * 100.f << std::setw(20) << update_time * 1e3 << refit_time * 1e3 << std::endl;
+    }
+
+    // Long thin objects in random orientations, like poles or beams, where
+    // the world space box is much larger than the object
+    {
+        std::uniform_real_distribution<float> length(1.f, 8.f);
+        std::uniform_real_distribution<float> thickness(0.1f, 0.5f);
+        std::uniform_real_distribution<float> angle(-glm::pi<float>(), glm::pi<float>());
+
+        box_set world_boxes;
+        sphere_set spheres;
+        obb_set oriented;
+
+        for (int i = 0; i < 1000000; ++i)
+        {
+            glm::vec3 const half_size{length(random), thickness(random), thickness(random)};
+            glm::vec3 const axis = glm::normalize(glm::vec3(position(random), position(random), position(random)) + glm::vec3(1e-3f));
+            glm::mat4 const model = glm::translate(glm::mat4(1.f), glm::vec3(position(random), position(random) * 0.1f, position(random)))
+                * glm::mat4_cast(glm::angleAxis(angle(random), axis));
+
+            // Fitted from the corners, as they would be from the vertices
+            glm::vec3 corners[8];
+            for (int c = 0; c < 8; ++c)
+                corners[c] = half_size * glm::vec3((c & 1) ? 1.f : -1.f, (c & 2) ? 1.f : -1.f, (c & 4) ? 1.f : -1.f);
+
+            auto const [min, max] = transform_bounds(model, -half_size, half_size);
+            world_boxes.push_back(min, max);
+            spheres.push_back(transform(model, fit_sphere(corners)));
+            oriented.push_back(transform(model, fit_obb(corners)));
+        }
+
+        frustum_planes const planes(cameras[0].view_projection);
+        frustum const view_frustum(cameras[0].view_projection);
+
+        std::vector<std::uint32_t> box_visible, sphere_visible, obb_visible, exact;
+
+        double const box_time = measure([&]{ box_visible.clear(); cull_boxes(planes, world_boxes, box_visible); });
+        double const sphere_time = measure([&]{ sphere_visible.clear(); cull_spheres(planes, spheres, sphere_visible); });
+        double const obb_time = measure([&]{ obb_visible.clear(); cull_obbs(planes, oriented, obb_visible); });
+
+        std::vector<std::uint32_t> reference;
+        cull_spheres_reference(planes, spheres, reference);
+        std::size_t const sphere_mismatches = count_mismatches(reference, sphere_visible);
+        reference.clear();
+        cull_obbs_reference(planes, oriented, reference);
+        std::size_t const obb_mismatches = count_mismatches(reference, obb_visible);
+
+        // The objects are exactly their oriented boxes
+        exact = obb_visible;
+        refine_visible(view_frustum, oriented, exact);
+
+        std::cout << std::left << std::setw(36) << "rotated objects, wide" << std::setw(12) << "time, ms" << std::setw(16) << "visible"
+            << std::setw(16) << "false positive" << "mismatches" << std::endl;
+
+        auto row = [&](std::string const & name, double time, std::size_t visible, std::size_t mismatches)
+        {
+            std::cout << std::left << std::setw(36) << name << std::setw(12) << time * 1e3 << std::setw(16) << visible
+                << std::setw(16) << visible - exact.size() << mismatches << std::endl;
+        };
+
+        row("planes, world AABB", box_time, box_visible.size(), 0);
+        row("planes, sphere", sphere_time, sphere_visible.size(), sphere_mismatches);
+        row("planes, OBB", obb_time, obb_visible.size(), obb_mismatches);
+        row("exact", 0.0, exact.size(), 0);
+    }
+}
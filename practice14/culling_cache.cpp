@@ -0,0 +1,83 @@
+#include "culling_cache.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <limits>
+
+// Distance from the point to the boundary of the body, or a lower bound of
+// it: the body is the intersection of the slabs between its supporting
+// planes along its face normals. Negative if the point is outside
+template <typename Body>
+static float inside_margin(Body const & b, glm::vec3 const & p)
+{
+	float result = std::numeric_limits<float>::infinity();
+	for (auto const & n : b.face_normals)
+	{
+		auto const [min, max] = project(b, n);
+		float const v = glm::dot(p, n);
+		result = std::min(result, std::min(v - min, max - v) / glm::length(n));
+	}
+	return result;
+}
+
+culling_cache::stats culling_cache::refine(frustum const & view_frustum, box_set const & boxes, std::vector<std::uint32_t> & visible)
+{
+	entries_.resize(boxes.size());
+
+	// Every point of the new frustum is within `delta` of the old one and
+	// vice versa. Summed over the frames, that bounds how far the frustum
+	// got from where any cached result was proven, also for objects that
+	// weren't tested in between, so a result with a larger margin still holds
+	if (previous_)
+	{
+		float delta = 0.f;
+		for (std::size_t i = 0; i < view_frustum.vertices.size(); ++i)
+			delta = std::max(delta, glm::distance(view_frustum.vertices[i], previous_->vertices[i]));
+		travelled_ += delta;
+	}
+	previous_ = view_frustum;
+
+	stats result;
+
+	auto test = [&](std::uint32_t i)
+	{
+		auto & e = entries_[i];
+		glm::vec3 const min = boxes.min(i);
+		glm::vec3 const max = boxes.max(i);
+
+		++result.objects;
+
+		if (e.min == min && e.max == max && e.margin > travelled_ - e.computed_at)
+		{
+			++result.skipped;
+			return e.inside;
+		}
+
+		aabb const box(min, max);
+		e.min = min;
+		e.max = max;
+		e.computed_at = travelled_;
+		e.inside = intersect(box, view_frustum, e.axis, result.axes_tested);
+
+		if (e.inside)
+		{
+			e.margin = inside_margin(view_frustum, (min + max) * 0.5f);
+		}
+		else
+		{
+			glm::vec3 const n = separating_axis(box, view_frustum, e.axis);
+			auto const [min1, max1] = project(box, n);
+			auto const [min2, max2] = project(view_frustum, n);
+			e.margin = std::max(min2 - max1, min1 - max2) / glm::length(n);
+		}
+
+		return e.inside;
+	};
+
+	visible.erase(std::remove_if(visible.begin(), visible.end(), [&](std::uint32_t i){ return !test(i); }), visible.end());
+
+	return result;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "culling.hpp"
+#include "frustum.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Exact box-frustum culling that reuses the results of the previous frames.
+//
+// For every object the cache keeps the axis that separated it from the
+// frustum last time, which is tested first and usually separates it again.
+// It also keeps a margin: how far the frustum may move before the result can
+// change. For a separated object that is the gap along the separating axis;
+// for an intersecting one it is how deep the box center lies inside the
+// frustum. While the frustum vertices have moved less than the margin in
+// total since the result was computed, counting the frames the object
+// wasn't a candidate as well, the object is not tested at all.
+struct culling_cache
+{
+	struct stats
+	{
+		std::size_t objects = 0;
+		// Objects whose result was proven from the margin without testing
+		std::size_t skipped = 0;
+		std::size_t axes_tested = 0;
+
+		float average_axes() const { return objects ? float(axes_tested) / objects : 0.f; }
+	};
+
+	// Same as refine_visible(), the boxes are identified by their index
+	stats refine(frustum const & view_frustum, box_set const & boxes, std::vector<std::uint32_t> & visible);
+
+private:
+	struct entry
+	{
+		// The box the state was computed for, a changed box is retested
+		glm::vec3 min{0.f};
+		glm::vec3 max{0.f};
+
+		bool inside = false;
+		// Axis that separated the box, in the order of separating_axis()
+		std::size_t axis = -1;
+		// Non-positive if nothing is known
+		float margin = 0.f;
+		// The value of travelled_ when the margin was computed
+		double computed_at = 0.0;
+	};
+
+	std::vector<entry> entries_;
+	// How far the frustum vertices have moved since the first frame, summed
+	// over the frames
+	double travelled_ = 0.0;
+	std::optional<frustum> previous_;
+};
@@ -0,0 +1,125 @@
+#include "depth_pyramid.hpp"
+
+#include <algorithm>
+
+depth_pyramid::depth_pyramid(GLuint reduce_program)
+	: reduce_program_(reduce_program)
+	, source_location_(glGetUniformLocation(reduce_program, "source"))
+	, source_level_location_(glGetUniformLocation(reduce_program, "source_level"))
+	, source_size_location_(glGetUniformLocation(reduce_program, "source_size"))
+{
+	// The fullscreen triangle has no vertex attributes
+	glGenVertexArrays(1, &vao_);
+	glGenFramebuffers(1, &depth_framebuffer_);
+	glGenFramebuffers(1, &pyramid_framebuffer_);
+}
+
+void depth_pyramid::allocate(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+
+	// Blitting depth needs the same format as the default framebuffer has
+	GLint depth_bits = 24, stencil_bits = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_bits);
+	glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits);
+
+	GLenum const depth_format = stencil_bits > 0 ? GL_DEPTH24_STENCIL8 : (depth_bits > 24 ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24);
+	GLenum const attachment = stencil_bits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+
+	if (depth_texture_)
+		glDeleteTextures(1, &depth_texture_);
+	glGenTextures(1, &depth_texture_);
+	glBindTexture(GL_TEXTURE_2D, depth_texture_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, depth_format, width, height, 0,
+		stencil_bits > 0 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT,
+		stencil_bits > 0 ? GL_UNSIGNED_INT_24_8 : GL_FLOAT, nullptr);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+	glFramebufferTexture(GL_DRAW_FRAMEBUFFER, attachment, depth_texture_, 0);
+	glDrawBuffer(GL_NONE);
+
+	// Levels down to 1x1, each half of the previous one rounded up
+	if (pyramid_)
+		glDeleteTextures(1, &pyramid_);
+	glGenTextures(1, &pyramid_);
+	glBindTexture(GL_TEXTURE_2D, pyramid_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	levels_ = 0;
+	for (int w = (width + 1) / 2, h = (height + 1) / 2; ; w = (w + 1) / 2, h = (h + 1) / 2)
+	{
+		glTexImage2D(GL_TEXTURE_2D, levels_++, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, nullptr);
+		if (w == 1 && h == 1)
+			break;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+void depth_pyramid::update(int width, int height, glm::mat4 const & view_projection)
+{
+	if (width != width_ || height != height_)
+		allocate(width, height);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glUseProgram(reduce_program_);
+	glUniform1i(source_location_, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vao_);
+	glBindFramebuffer(GL_FRAMEBUFFER, pyramid_framebuffer_);
+	glDisable(GL_DEPTH_TEST);
+
+	int source_width = width;
+	int source_height = height;
+	for (int level = 0; level < levels_; ++level)
+	{
+		if (level == 0)
+		{
+			glBindTexture(GL_TEXTURE_2D, depth_texture_);
+			glUniform1i(source_level_location_, 0);
+		}
+		else
+		{
+			// Only the previous level can be read, so that the level being
+			// written isn't a feedback loop
+			glBindTexture(GL_TEXTURE_2D, pyramid_);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			glUniform1i(source_level_location_, level - 1);
+		}
+		glUniform2i(source_size_location_, source_width, source_height);
+
+		int const target_width = (source_width + 1) / 2;
+		int const target_height = (source_height + 1) / 2;
+
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pyramid_, level);
+		glViewport(0, 0, target_width, target_height);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		source_width = target_width;
+		source_height = target_height;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, pyramid_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	view_projection_ = view_projection;
+	valid_ = true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/mat4x4.hpp>
+
+// Hierarchical max-depth mip chain (Hi-Z) of the default framebuffer, built
+// on the GPU for occlusion tests in the next frame.
+//
+// The depth buffer is copied into a depth texture; a fragment shader then
+// reduces it 2x2 at a time into the levels of an R32F texture, keeping the
+// farthest depth. Level 0 is half the window size, rounded up, and every
+// texel of level l covers 2^(l+1) window pixels in each direction. A box
+// whose nearest depth is farther than the pyramid value under its whole
+// screen rectangle was hidden when the pyramid was built.
+//
+// The copy resolves the multisampled depth to one sample per pixel, which
+// may let a box slip behind an edge by less than a pixel.
+struct depth_pyramid
+{
+	// The reduce program draws a fullscreen triangle from gl_VertexID and
+	// writes the maximum of the 2x2 block of `source` at source_level
+	explicit depth_pyramid(GLuint reduce_program);
+
+	// Rebuilds the pyramid from the depth buffer of the default framebuffer
+	// that was rendered with the view_projection, leaves the default
+	// framebuffer bound with the full window viewport
+	void update(int width, int height, glm::mat4 const & view_projection);
+
+	// Whether a pyramid was built yet
+	bool valid() const { return valid_; }
+
+	GLuint texture() const { return pyramid_; }
+	int levels() const { return levels_; }
+	// Window size the pyramid was built for
+	int width() const { return width_; }
+	int height() const { return height_; }
+	glm::mat4 const & view_projection() const { return view_projection_; }
+
+private:
+	void allocate(int width, int height);
+
+	GLuint reduce_program_;
+	GLint source_location_;
+	GLint source_level_location_;
+	GLint source_size_location_;
+
+	GLuint vao_;
+	GLuint depth_texture_ = 0;
+	GLuint depth_framebuffer_;
+	GLuint pyramid_ = 0;
+	GLuint pyramid_framebuffer_;
+
+	int width_ = 0;
+	int height_ = 0;
+	int levels_ = 0;
+	bool valid_ = false;
+	glm::mat4 view_projection_{1.f};
+};
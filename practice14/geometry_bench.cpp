@@ -0,0 +1,170 @@
+// Headless micro-benchmark of the geometry kernels of the course: the
+// separating axis test with the box and frustum it works on, De Casteljau
+// evaluation of Bezier curves from practice3, sphere generation from
+// practice10 and animation spline sampling from practice13. Each kernel
+// runs for a few input sizes and reports the time of one call and the
+// number of items it gets through per second, so that changes to any of
+// them can be checked for regressions.
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "benchmark.hpp"
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+
+#include "../practice3/bezier.hpp"
+#include "../practice10/sphere.hpp"
+#include "../practice13/gltf_loader.hpp"
+
+// Results are added here so that the compiler can't drop the calls
+static volatile float sink = 0.f;
+
+static void report(std::string const & kernel, std::size_t size, double time_per_op, double items_per_op)
+{
+    std::cout << std::left << std::setw(28) << kernel
+        << std::setw(12) << size
+        << std::setw(14) << time_per_op * 1e9
+        << items_per_op / time_per_op * 1e-6 << std::endl;
+}
+
+int main()
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    std::cout << "Items are boxes, box-frustum pairs, frustums, control points, sphere vertices and spline samples" << std::endl;
+    std::cout << std::left << std::setw(28) << "kernel"
+        << std::setw(12) << "size"
+        << std::setw(14) << "ns/op"
+        << "Mitems/s" << std::endl;
+
+    // Boxes scattered over the scene and a camera that sees part of them,
+    // so that the test exits early for some and runs every axis for others;
+    // the size is the working set, which stops fitting the caches
+    glm::mat4 const view_projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 300.f)
+        * glm::lookAt(glm::vec3(0.f, 20.f, 0.f), glm::vec3(100.f, 0.f, 50.f), glm::vec3(0.f, 1.f, 0.f));
+    frustum const view_frustum(view_projection);
+
+    for (std::size_t count : {1024, 65536, 1048576})
+    {
+        std::vector<std::pair<glm::vec3, glm::vec3>> corners(count);
+        for (auto & [min, max] : corners)
+        {
+            min = glm::vec3(unit(random) * 1000.f - 500.f, unit(random) * 100.f - 50.f, unit(random) * 1000.f - 500.f);
+            max = min + glm::vec3(0.1f) + 4.f * glm::vec3(unit(random), unit(random), unit(random));
+        }
+
+        std::vector<aabb> boxes;
+        boxes.reserve(count);
+
+        double const construction_time = measure([&]{
+            boxes.clear();
+            for (auto const & [min, max] : corners)
+                boxes.emplace_back(min, max);
+            sink = sink + boxes.back().vertices[7].x;
+        });
+
+        double const intersect_time = measure([&]{
+            int visible = 0;
+            for (auto const & box : boxes)
+                visible += intersect(view_frustum, box);
+            sink = sink + visible;
+        });
+
+        report("aabb", count, construction_time / count, 1.0);
+        report("intersect(frustum, aabb)", count, intersect_time / count, 1.0);
+    }
+
+    {
+        std::vector<glm::mat4> matrices(1024);
+        for (std::size_t i = 0; i < matrices.size(); ++i)
+            matrices[i] = glm::rotate(view_projection, unit(random) * glm::pi<float>(), glm::vec3(0.f, 1.f, 0.f));
+
+        double const time = measure([&]{
+            for (auto const & m : matrices)
+                sink = sink + frustum(m).vertices[0].x;
+        });
+
+        report("frustum", matrices.size(), time / matrices.size(), 1.0);
+    }
+
+    // Samples spread over the curve, the way practice3 tessellates it
+    std::vector<float> parameters(1024);
+    for (auto & t : parameters)
+        t = unit(random);
+
+    for (std::size_t count : {4, 16, 64})
+    {
+        std::vector<practice3::vertex> control_points(count);
+        for (auto & v : control_points)
+            v.position = {unit(random) * 800.f, unit(random) * 600.f};
+
+        double const time = measure([&]{
+            for (float t : parameters)
+                sink = sink + practice3::bezier(control_points, t).x;
+        });
+
+        report("bezier", count, time / parameters.size(), count);
+    }
+
+    for (int quality : {4, 16, 64})
+    {
+        std::size_t vertex_count = 0;
+        double const time = measure([&]{
+            auto const [vertices, indices] = practice10::generate_sphere(1.f, quality);
+            vertex_count = vertices.size();
+            sink = sink + vertices.back().position.x + indices.back();
+        });
+
+        report("generate_sphere", quality, time, vertex_count);
+    }
+
+    // Keyframes at irregular intervals, sampled at random times; the size
+    // is the number of keyframes the binary search runs over
+    for (std::size_t count : {4, 64, 1024})
+    {
+        gltf_model::spline<glm::vec3> translation;
+        gltf_model::spline<glm::quat> rotation;
+
+        float time = 0.f;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            time += 0.01f + unit(random) * 0.05f;
+            translation.timestamps.push_back(time);
+            rotation.timestamps.push_back(time);
+            translation.values.push_back({unit(random), unit(random), unit(random)});
+            rotation.values.push_back(glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random))));
+        }
+
+        std::vector<float> times(1024);
+        for (auto & t : times)
+            t = unit(random) * time;
+
+        double const translation_time = measure([&]{
+            for (float t : times)
+                sink = sink + translation(t).x;
+        });
+
+        double const rotation_time = measure([&]{
+            for (float t : times)
+                sink = sink + rotation(t).w;
+        });
+
+        report("spline<vec3>", count, translation_time / times.size(), 1.0);
+        report("spline<quat>", count, rotation_time / times.size(), 1.0);
+    }
+}
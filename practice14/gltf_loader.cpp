@@ -1,8 +1,11 @@
 #include "gltf_loader.hpp"
+#include "meshopt_decoder.hpp"
 
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
 
+#include <glm/gtx/matrix_decompose.hpp>
+
 #include <fstream>
 #include <stdexcept>
 
@@ -15,6 +18,114 @@ static unsigned int attribute_type_to_size(std::string const & type)
     return 0;
 }
 
+static std::vector<char> read_buffer(rapidjson::Value const & buffer, std::filesystem::path const & directory)
+{
+    if (!buffer.HasMember("uri"))
+        throw std::runtime_error("glTF buffer without uri is referenced");
+
+    auto const buffer_path = directory / buffer["uri"].GetString();
+
+    std::vector<char> result(std::filesystem::file_size(buffer_path));
+    std::ifstream input(buffer_path, std::ios::binary);
+    input.read(result.data(), result.size());
+    return result;
+}
+
+// Appends the data of all buffer views to the model buffer and returns
+// where each view ended up. Views compressed with EXT_meshopt_compression
+// are decoded, and buffers that are only referenced by compressed views
+// (the compressed data itself) aren't kept in the model buffer
+static std::vector<gltf_model::buffer_view> load_buffer_views(rapidjson::Document const & document, std::filesystem::path const & directory, std::vector<char> & buffer)
+{
+    auto const buffers = document["buffers"].GetArray();
+    auto const views = document["bufferViews"].GetArray();
+
+    auto meshopt_extension = [](rapidjson::Value const & view) -> rapidjson::Value const *
+    {
+        if (!view.HasMember("extensions") || !view["extensions"].HasMember("EXT_meshopt_compression"))
+            return nullptr;
+        return &view["extensions"]["EXT_meshopt_compression"];
+    };
+
+    auto align = [&]
+    {
+        buffer.resize((buffer.size() + 15) & ~std::size_t(15));
+    };
+
+    std::vector<std::optional<std::size_t>> buffer_offsets(buffers.Size());
+    for (auto const & view : views)
+    {
+        if (meshopt_extension(view)) continue;
+
+        unsigned int const index = view["buffer"].GetUint();
+        if (buffer_offsets[index]) continue;
+
+        align();
+        buffer_offsets[index] = buffer.size();
+
+        auto const data = read_buffer(buffers[index], directory);
+        buffer.insert(buffer.end(), data.begin(), data.end());
+    }
+
+    std::vector<std::optional<std::vector<char>>> compressed_buffers(buffers.Size());
+
+    std::vector<gltf_model::buffer_view> result;
+    for (auto const & view : views)
+    {
+        unsigned int const stride = view.HasMember("byteStride") ? view["byteStride"].GetUint() : 0;
+
+        auto const extension = meshopt_extension(view);
+        if (!extension)
+        {
+            unsigned int const offset = view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0;
+            result.push_back({static_cast<unsigned int>(*buffer_offsets[view["buffer"].GetUint()] + offset), view["byteLength"].GetUint(), stride});
+            continue;
+        }
+
+        auto const & compression = *extension;
+
+        unsigned int const source_index = compression["buffer"].GetUint();
+        if (!compressed_buffers[source_index])
+            compressed_buffers[source_index] = read_buffer(buffers[source_index], directory);
+
+        auto const source = reinterpret_cast<unsigned char const *>(compressed_buffers[source_index]->data())
+            + (compression.HasMember("byteOffset") ? compression["byteOffset"].GetUint() : 0);
+        std::size_t const source_size = compression["byteLength"].GetUint();
+
+        std::size_t const count = compression["count"].GetUint();
+        std::size_t const element_size = compression["byteStride"].GetUint();
+
+        align();
+        std::size_t const offset = buffer.size();
+        buffer.resize(offset + count * element_size);
+        auto const destination = buffer.data() + offset;
+
+        std::string const mode = compression["mode"].GetString();
+        if (mode == "ATTRIBUTES")
+            meshopt_decode_vertex_buffer(destination, count, element_size, source, source_size);
+        else if (mode == "TRIANGLES")
+            meshopt_decode_index_buffer(destination, count, element_size, source, source_size);
+        else if (mode == "INDICES")
+            meshopt_decode_index_sequence(destination, count, element_size, source, source_size);
+        else
+            throw std::runtime_error("Unknown meshopt compression mode: " + mode);
+
+        std::string const filter = compression.HasMember("filter") ? compression["filter"].GetString() : "NONE";
+        if (filter == "OCTAHEDRAL")
+            meshopt_decode_filter_oct(destination, count, element_size);
+        else if (filter == "QUATERNION")
+            meshopt_decode_filter_quat(destination, count, element_size);
+        else if (filter == "EXPONENTIAL")
+            meshopt_decode_filter_exp(destination, count, element_size);
+        else if (filter != "NONE")
+            throw std::runtime_error("Unknown meshopt filter: " + filter);
+
+        result.push_back({static_cast<unsigned int>(offset), static_cast<unsigned int>(count * element_size), stride});
+    }
+
+    return result;
+}
+
 gltf_model load_gltf(std::filesystem::path const & path)
 {
     rapidjson::Document document;
@@ -25,35 +136,39 @@ gltf_model load_gltf(std::filesystem::path const & path)
         document.ParseStream(stream);
     }
 
-    gltf_model result;
-
+    if (document.HasMember("extensionsRequired"))
     {
-        auto buffers = document["buffers"].GetArray();
-        assert(buffers.Size() == 1);
+        for (auto const & extension : document["extensionsRequired"].GetArray())
+        {
+            std::string const name = extension.GetString();
+            if (name != "KHR_mesh_quantization" && name != "EXT_meshopt_compression")
+                throw std::runtime_error("Unsupported glTF extension: " + name);
+        }
+    }
 
-        auto const buffer_uri = buffers[0]["uri"].GetString();
+    gltf_model result;
 
-        auto const buffer_path = path.parent_path() / buffer_uri;
-
-        result.buffer.resize(std::filesystem::file_size(buffer_path));
-        std::ifstream buffer(buffer_path, std::ios::binary);
-        buffer.read(result.buffer.data(), result.buffer.size());
-    }
+    std::vector<gltf_model::buffer_view> buffer_views = load_buffer_views(document, path.parent_path(), result.buffer);
 
     auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
     {
-        auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
+        return buffer_views.at(index);
     };
 
     auto parse_accessor = [&](int index) -> gltf_model::accessor
     {
         auto accessor = document["accessors"].GetArray()[index].GetObject();
+
+        auto view = parse_buffer_view(accessor["bufferView"].GetInt());
+        if (accessor.HasMember("byteOffset"))
+            view.offset += accessor["byteOffset"].GetUint();
+
         return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
+            view,
             accessor["componentType"].GetUint(),
             attribute_type_to_size(accessor["type"].GetString()),
             accessor["count"].GetUint(),
+            accessor.HasMember("normalized") && accessor["normalized"].GetBool(),
         };
     };
 
@@ -120,5 +235,49 @@ gltf_model load_gltf(std::filesystem::path const & path)
             result_mesh.material.color = parse_color(pbr["baseColorFactor"].GetArray());
     }
 
+    if (document.HasMember("nodes"))
+    {
+        auto nodes = document["nodes"].GetArray();
+
+        for (auto const & node : nodes)
+        {
+            auto & result_node = result.nodes.emplace_back();
+
+            if (node.HasMember("name"))
+                result_node.name = node["name"].GetString();
+            if (node.HasMember("mesh"))
+                result_node.mesh = node["mesh"].GetUint();
+
+            if (node.HasMember("matrix"))
+            {
+                glm::mat4 matrix;
+                for (int i = 0; i < 16; ++i)
+                    matrix[i / 4][i % 4] = node["matrix"][i].GetFloat();
+
+                glm::vec3 skew;
+                glm::vec4 perspective;
+                glm::decompose(matrix, result_node.scale, result_node.rotation, result_node.translation, skew, perspective);
+            }
+
+            if (node.HasMember("translation"))
+                result_node.translation = parse_vector(node["translation"]);
+            if (node.HasMember("rotation"))
+            {
+                auto const & rotation = node["rotation"];
+                result_node.rotation = glm::quat(rotation[3].GetFloat(), rotation[0].GetFloat(), rotation[1].GetFloat(), rotation[2].GetFloat());
+            }
+            if (node.HasMember("scale"))
+                result_node.scale = parse_vector(node["scale"]);
+        }
+
+        for (int i = 0; i < nodes.Size(); ++i)
+        {
+            if (!nodes[i].HasMember("children")) continue;
+
+            for (auto const & child : nodes[i]["children"].GetArray())
+                result.nodes[child.GetInt()].parent = i;
+        }
+    }
+
     return result;
 }
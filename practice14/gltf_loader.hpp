@@ -18,14 +18,19 @@ struct gltf_model
     {
         unsigned int offset;
         unsigned int size;
+        // 0 for tightly packed data
+        unsigned int stride = 0;
     };
 
     struct accessor
     {
+        // The view offset includes the accessor's own offset
         buffer_view view;
         unsigned int type;
         unsigned int size;
         unsigned int count;
+        // Integer data mapped to [0, 1] or [-1, 1], see KHR_mesh_quantization
+        bool normalized = false;
     };
 
     struct material
@@ -51,8 +56,22 @@ struct gltf_model
         glm::vec3 max;
     };
 
+    struct node
+    {
+        std::string name;
+        // Index of the parent node, -1 for root nodes
+        int parent = -1;
+        std::optional<unsigned int> mesh;
+
+        // Local transform, nodes with a matrix are decomposed on load
+        glm::vec3 translation{0.f};
+        glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale{1.f};
+    };
+
     std::vector<char> buffer;
     std::vector<mesh> meshes;
+    std::vector<node> nodes;
 };
 
 gltf_model load_gltf(std::filesystem::path const & path);
@@ -0,0 +1,218 @@
+#include "gpu_culling.hpp"
+#include "culling.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Must match the size of the lod_error array of the cull program
+static constexpr std::size_t max_lod_count = 16;
+
+gpu_culling::gpu_culling(GLuint cull_program, lod_chain const & chain, glm::vec3 const & bounds_min, glm::vec3 const & bounds_max, int ring_size)
+	: cull_program_(cull_program)
+	, instance_matrices_location_(glGetUniformLocation(cull_program, "instance_matrices"))
+	, planes_location_(glGetUniformLocation(cull_program, "planes"))
+	, bounds_min_location_(glGetUniformLocation(cull_program, "bounds_min"))
+	, bounds_max_location_(glGetUniformLocation(cull_program, "bounds_max"))
+	, camera_position_location_(glGetUniformLocation(cull_program, "camera_position"))
+	, pixels_per_unit_location_(glGetUniformLocation(cull_program, "pixels_per_unit"))
+	, max_error_location_(glGetUniformLocation(cull_program, "max_error"))
+	, lod_error_location_(glGetUniformLocation(cull_program, "lod_error"))
+	, lod_count_location_(glGetUniformLocation(cull_program, "lod_count"))
+	, lod_level_location_(glGetUniformLocation(cull_program, "lod_level"))
+	, use_hi_z_location_(glGetUniformLocation(cull_program, "use_hi_z"))
+	, hi_z_location_(glGetUniformLocation(cull_program, "hi_z"))
+	, hi_z_view_projection_location_(glGetUniformLocation(cull_program, "hi_z_view_projection"))
+	, hi_z_screen_size_location_(glGetUniformLocation(cull_program, "hi_z_screen_size"))
+	, hi_z_levels_location_(glGetUniformLocation(cull_program, "hi_z_levels"))
+	, chain_(chain)
+	, bounds_min_(bounds_min)
+	, bounds_max_(bounds_max)
+	, ring_(std::max(ring_size, 2))
+	, current_(ring_.size() - 1)
+{
+	if (chain.levels.empty() || chain.levels.size() > max_lod_count)
+		throw std::runtime_error("GPU culling supports 1 to 16 levels of detail");
+
+	// The cull pass has no vertex attributes, it works from gl_VertexID
+	glGenVertexArrays(1, &vao_);
+
+	glGenBuffers(1, &matrix_buffer_);
+	glGenTextures(1, &matrix_texture_);
+
+	for (auto & set : ring_)
+	{
+		std::size_t const levels = chain.levels.size();
+		set.buffers.resize(levels);
+		set.textures.resize(levels);
+		set.queries.resize(levels);
+		glGenBuffers(levels, set.buffers.data());
+		glGenTextures(levels, set.textures.data());
+		glGenQueries(levels, set.queries.data());
+	}
+}
+
+void gpu_culling::allocate(std::size_t capacity)
+{
+	capacity_ = capacity;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer_);
+	glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, matrix_texture_);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrix_buffer_);
+
+	for (auto & set : ring_)
+	{
+		for (std::size_t level = 0; level < set.buffers.size(); ++level)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, set.buffers[level]);
+			glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_COPY);
+			glBindTexture(GL_TEXTURE_BUFFER, set.textures[level]);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, set.buffers[level]);
+		}
+		set.pending = false;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// The old results may refer to instances that no longer exist
+	batches_.clear();
+}
+
+void gpu_culling::update_instances(std::span<glm::mat4 const> matrices)
+{
+	if (matrices.size() > capacity_)
+		allocate(matrices.size());
+
+	instance_count_ = matrices.size();
+
+	// Orphaning the storage lets the driver hand out fresh memory instead of
+	// waiting for the draws that still read the previous frame's matrices
+	glBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer_);
+	glBufferData(GL_TEXTURE_BUFFER, capacity_ * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, matrices.size_bytes(), matrices.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void gpu_culling::cull(glm::mat4 const & view_projection, glm::vec3 const & camera_position, float pixels_per_unit, lod_settings const & settings,
+	depth_pyramid const * occlusion)
+{
+	collect();
+
+	if (instance_count_ == 0)
+		return;
+
+	// Never overwrite the results that are being drawn
+	if (next_ == current_)
+		next_ = (next_ + 1) % ring_.size();
+	auto & set = ring_[next_];
+	next_ = (next_ + 1) % ring_.size();
+
+	frustum_planes const planes(view_projection);
+
+	float lod_error[max_lod_count] = {};
+	for (std::size_t level = 0; level < chain_.levels.size(); ++level)
+		lod_error[level] = chain_.levels[level].error;
+
+	glUseProgram(cull_program_);
+	glUniform1i(instance_matrices_location_, 0);
+	glUniform4fv(planes_location_, planes.planes.size(), reinterpret_cast<float const *>(planes.planes.data()));
+	glUniform3fv(bounds_min_location_, 1, reinterpret_cast<float const *>(&bounds_min_));
+	glUniform3fv(bounds_max_location_, 1, reinterpret_cast<float const *>(&bounds_max_));
+	glUniform3fv(camera_position_location_, 1, reinterpret_cast<float const *>(&camera_position));
+	glUniform1f(pixels_per_unit_location_, pixels_per_unit);
+	glUniform1f(max_error_location_, settings.max_error);
+	glUniform1fv(lod_error_location_, max_lod_count, lod_error);
+	glUniform1i(lod_count_location_, chain_.levels.size());
+
+	bool const use_hi_z = occlusion && occlusion->valid();
+	glUniform1i(use_hi_z_location_, use_hi_z);
+	if (use_hi_z)
+	{
+		glUniform1i(hi_z_location_, 1);
+		glUniformMatrix4fv(hi_z_view_projection_location_, 1, GL_FALSE, reinterpret_cast<float const *>(&occlusion->view_projection()));
+		glUniform2f(hi_z_screen_size_location_, occlusion->width(), occlusion->height());
+		glUniform1i(hi_z_levels_location_, occlusion->levels());
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, occlusion->texture());
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, matrix_texture_);
+	glBindVertexArray(vao_);
+
+	glEnable(GL_RASTERIZER_DISCARD);
+
+	for (std::size_t level = 0; level < chain_.levels.size(); ++level)
+	{
+		glUniform1i(lod_level_location_, level);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, set.buffers[level]);
+
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, set.queries[level]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, instance_count_);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	}
+
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	if (use_hi_z)
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	set.pending = true;
+	set.serial = ++serial_;
+}
+
+void gpu_culling::collect()
+{
+	// The newest set whose counts are all available replaces the current one
+	std::size_t newest = current_;
+	std::uint64_t newest_serial = 0;
+
+	for (std::size_t i = 0; i < ring_.size(); ++i)
+	{
+		auto const & set = ring_[i];
+		if (!set.pending || set.serial <= newest_serial)
+			continue;
+
+		GLuint available = GL_TRUE;
+		for (GLuint query : set.queries)
+		{
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+		}
+
+		if (available)
+		{
+			newest = i;
+			newest_serial = set.serial;
+		}
+	}
+
+	if (newest_serial == 0)
+		return;
+
+	// Older sets are out of date and free to be written into
+	for (auto & set : ring_)
+		if (set.serial <= newest_serial)
+			set.pending = false;
+
+	current_ = newest;
+	auto const & set = ring_[current_];
+
+	batches_.clear();
+	for (std::size_t level = 0; level < set.queries.size(); ++level)
+	{
+		GLuint count = 0;
+		glGetQueryObjectuiv(set.queries[level], GL_QUERY_RESULT, &count);
+		batches_.push_back({static_cast<std::uint32_t>(level), set.textures[level], static_cast<GLsizei>(count)});
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "lod.hpp"
+#include "depth_pyramid.hpp"
+
+// Frustum culling and LOD selection of instances on the GPU with transform
+// feedback, for GL 3.3 which has no compute shaders.
+//
+// The instance matrices live in a texture buffer. The cull program runs one
+// point per instance with rasterization disabled: its vertex shader tests
+// the transformed bounds against the frustum planes and picks a level, its
+// geometry shader emits the index of the instance only if it is visible and
+// has the level of the current pass. One pass per level thus writes a
+// compacted index buffer per level, which instanced draws read through
+// texture buffers as well.
+//
+// The number of indices written is only known from a transform feedback
+// primitives written query, and GL 3.3 can't draw with a count that stays
+// on the GPU. So the results go to a ring of buffers and are drawn once
+// their queries are available, usually a frame or two later, instead of
+// stalling the CPU. The matrices are always the current ones, only the
+// visible set lags.
+struct gpu_culling
+{
+	struct batch
+	{
+		// Level of the lod chain drawn by the batch
+		std::uint32_t level;
+		// R32UI texture buffer of instance indices into the matrices
+		GLuint indices;
+		GLsizei count;
+	};
+
+	// The cull program must capture the `instance_index` output of its
+	// geometry shader with transform feedback
+	gpu_culling(GLuint cull_program, lod_chain const & chain, glm::vec3 const & bounds_min, glm::vec3 const & bounds_max, int ring_size = 3);
+
+	// Uploads the model matrices of all instances for this frame
+	void update_instances(std::span<glm::mat4 const> matrices);
+
+	// RGBA32F texture buffer with four texels per instance matrix
+	GLuint matrices() const { return matrix_texture_; }
+
+	// Issues the culling passes. There is no triangle budget: meeting it
+	// would need the totals of all instances before picking any level. The
+	// occlusion test is skipped without a valid pyramid
+	void cull(glm::mat4 const & view_projection, glm::vec3 const & camera_position, float pixels_per_unit, lod_settings const & settings,
+		depth_pyramid const * occlusion = nullptr);
+
+	// The latest results that are ready, one batch per level
+	std::vector<batch> const & batches() const { return batches_; }
+
+private:
+	struct result_set
+	{
+		std::vector<GLuint> buffers;
+		std::vector<GLuint> textures;
+		std::vector<GLuint> queries;
+		// Culled into but not read back yet
+		bool pending = false;
+		std::uint64_t serial = 0;
+	};
+
+	void allocate(std::size_t capacity);
+	void collect();
+
+	GLuint cull_program_;
+	GLint instance_matrices_location_;
+	GLint planes_location_;
+	GLint bounds_min_location_;
+	GLint bounds_max_location_;
+	GLint camera_position_location_;
+	GLint pixels_per_unit_location_;
+	GLint max_error_location_;
+	GLint lod_error_location_;
+	GLint lod_count_location_;
+	GLint lod_level_location_;
+	GLint use_hi_z_location_;
+	GLint hi_z_location_;
+	GLint hi_z_view_projection_location_;
+	GLint hi_z_screen_size_location_;
+	GLint hi_z_levels_location_;
+
+	lod_chain const & chain_;
+	glm::vec3 bounds_min_;
+	glm::vec3 bounds_max_;
+
+	GLuint vao_;
+	GLuint matrix_buffer_;
+	GLuint matrix_texture_;
+	std::size_t instance_count_ = 0;
+	std::size_t capacity_ = 0;
+
+	std::vector<result_set> ring_;
+	std::size_t next_ = 0;
+	std::uint64_t serial_ = 0;
+	// The set that batches_ point into, it's never written into
+	std::size_t current_;
+	std::vector<batch> batches_;
+};
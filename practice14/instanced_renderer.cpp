@@ -0,0 +1,94 @@
+#include "instanced_renderer.hpp"
+
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+
+static constexpr std::size_t instance_size = 3 * sizeof(glm::vec4);
+
+instanced_renderer::instanced_renderer(std::vector<GLuint> const & vaos, GLuint first_attribute)
+	: vaos_(vaos)
+	, first_attribute_(first_attribute)
+{
+	glGenBuffers(1, &buffer_);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+	glBufferData(GL_ARRAY_BUFFER, capacity_ * instance_size, nullptr, GL_STREAM_DRAW);
+
+	// Enabled attributes must always have a buffer, even in the draws that
+	// don't read them
+	for (GLuint vao : vaos_)
+	{
+		glBindVertexArray(vao);
+		for (GLuint row = 0; row < 3; ++row)
+		{
+			glEnableVertexAttribArray(first_attribute_ + row);
+			glVertexAttribDivisor(first_attribute_ + row, 1);
+		}
+		point_attributes(0);
+	}
+	glBindVertexArray(0);
+}
+
+void instanced_renderer::point_attributes(std::size_t first_instance)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+	for (GLuint row = 0; row < 3; ++row)
+	{
+		glVertexAttribPointer(first_attribute_ + row, 4, GL_FLOAT, GL_FALSE, instance_size,
+			reinterpret_cast<void *>(first_instance * instance_size + row * sizeof(glm::vec4)));
+	}
+}
+
+instanced_renderer::stats instanced_renderer::draw(gltf_model const & model, lod_chain const & chain, std::span<glm::mat4 const> matrices,
+	std::span<std::uint32_t const> levels, std::span<std::uint32_t const> visible)
+{
+	stats result;
+	result.instances = visible.size();
+	if (visible.empty())
+		return result;
+
+	// Counting sort of the visible instances by level
+	level_offsets_.assign(chain.levels.size() + 1, 0);
+	for (std::uint32_t i : visible)
+		++level_offsets_[levels[i] + 1];
+	for (std::size_t level = 0; level < chain.levels.size(); ++level)
+		level_offsets_[level + 1] += level_offsets_[level];
+
+	rows_.resize(3 * visible.size());
+	{
+		std::vector<std::size_t> next(level_offsets_.begin(), level_offsets_.end() - 1);
+		for (std::uint32_t i : visible)
+		{
+			glm::mat4 const transposed = glm::transpose(matrices[i]);
+			std::size_t const slot = next[levels[i]]++;
+			rows_[3 * slot + 0] = transposed[0];
+			rows_[3 * slot + 1] = transposed[1];
+			rows_[3 * slot + 2] = transposed[2];
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+	if (visible.size() > capacity_)
+		capacity_ = std::max(visible.size(), 2 * capacity_);
+	glBufferData(GL_ARRAY_BUFFER, capacity_ * instance_size, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, rows_.size() * sizeof(glm::vec4), rows_.data());
+
+	for (std::size_t level = 0; level < chain.levels.size(); ++level)
+	{
+		std::size_t const first = level_offsets_[level];
+		std::size_t const count = level_offsets_[level + 1] - first;
+		if (count == 0) continue;
+
+		auto const mesh_index = chain.levels[level].mesh;
+		auto const & mesh = model.meshes[mesh_index];
+
+		glBindVertexArray(vaos_[mesh_index]);
+		point_attributes(first);
+		glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset), count);
+
+		++result.draws;
+		result.triangles += count * chain.levels[level].triangles;
+	}
+
+	return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "gltf_loader.hpp"
+#include "lod.hpp"
+
+// Draws many instances of the levels of a lod chain with one instanced
+// draw call per level.
+//
+// The model matrices of the visible instances are grouped by level and
+// streamed to a vertex buffer every frame, which is orphaned before the
+// upload so that the driver never waits for the previous frame's draws.
+// The vertex shader reads them as per-instance attributes: only the affine
+// part is stored, as the three rows of a 3x4 matrix, 48 bytes per instance
+// instead of 64.
+//
+// GL 3.3 has no base instance, so every draw points the attributes of its
+// VAO at the first instance of its level.
+struct instanced_renderer
+{
+	struct stats
+	{
+		std::size_t instances = 0;
+		std::size_t draws = 0;
+		std::size_t triangles = 0;
+	};
+
+	// vaos[i] draws mesh i of the model. The matrix rows are attributes
+	// first_attribute to first_attribute + 2 of every VAO
+	instanced_renderer(std::vector<GLuint> const & vaos, GLuint first_attribute);
+
+	// Instance i has the model matrix matrices[i] and the level levels[i] of
+	// the chain; only the instances listed in `visible` are drawn. The VAO
+	// binding is left changed
+	stats draw(gltf_model const & model, lod_chain const & chain, std::span<glm::mat4 const> matrices, std::span<std::uint32_t const> levels,
+		std::span<std::uint32_t const> visible);
+
+private:
+	// Of the bound VAO
+	void point_attributes(std::size_t first_instance);
+
+	std::vector<GLuint> vaos_;
+	GLuint first_attribute_;
+
+	GLuint buffer_;
+	// In instances
+	std::size_t capacity_ = 1024;
+
+	std::vector<glm::vec4> rows_;
+	std::vector<std::size_t> level_offsets_;
+};
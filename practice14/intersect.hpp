@@ -61,3 +61,56 @@ bool intersect(Body1 const & b1, Body2 const & b2)
 
 	return true;
 }
+
+// Number of candidate separating axes of the two bodies
+template <typename Body1, typename Body2>
+std::size_t separating_axis_count(Body1 const & b1, Body2 const & b2)
+{
+	return b1.face_normals.size() + b2.face_normals.size() + b1.edge_directions.size() * b2.edge_directions.size();
+}
+
+// The candidate axis with the given index, in the order intersect() tests them
+template <typename Body1, typename Body2>
+glm::vec3 separating_axis(Body1 const & b1, Body2 const & b2, std::size_t index)
+{
+	if (index < b1.face_normals.size())
+		return b1.face_normals[index];
+	index -= b1.face_normals.size();
+
+	if (index < b2.face_normals.size())
+		return b2.face_normals[index];
+	index -= b2.face_normals.size();
+
+	return glm::cross(b1.edge_directions[index / b2.edge_directions.size()], b2.edge_directions[index % b2.edge_directions.size()]);
+}
+
+// Same as intersect(), but starts with the axis `hint`, e.g. the one that
+// separated the bodies in the previous frame. When the bodies don't
+// intersect, `hint` is set to the axis that separates them. The number of
+// tested axes is added to `tested`
+template <typename Body1, typename Body2>
+bool intersect(Body1 const & b1, Body2 const & b2, std::size_t & hint, std::size_t & tested)
+{
+	std::size_t const count = separating_axis_count(b1, b2);
+
+	if (hint < count)
+	{
+		++tested;
+		if (!intersect_along(b1, b2, separating_axis(b1, b2, hint)))
+			return false;
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (i == hint) continue;
+
+		++tested;
+		if (!intersect_along(b1, b2, separating_axis(b1, b2, i)))
+		{
+			hint = i;
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,103 @@
+#include "lod.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+lod_chain::lod_chain(gltf_model const & model, std::vector<std::uint32_t> const & meshes)
+{
+	for (std::uint32_t mesh : meshes)
+	{
+		auto const & m = model.meshes[mesh];
+		std::uint32_t const triangles = m.indices.count / 3;
+
+		glm::vec3 const d = m.max - m.min;
+		float const area = 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+
+		levels.push_back({mesh, triangles, std::sqrt(area / std::max<std::uint32_t>(triangles, 1))});
+	}
+
+	std::sort(levels.begin(), levels.end(), [](level const & a, level const & b){ return a.triangles > b.triangles; });
+}
+
+std::optional<std::uint32_t> lod_chain::level_of(std::uint32_t mesh) const
+{
+	for (std::uint32_t i = 0; i < levels.size(); ++i)
+		if (levels[i].mesh == mesh)
+			return i;
+	return std::nullopt;
+}
+
+lod_stats select_lods(lod_chain const & chain, lod_settings const & settings, glm::vec3 const & camera_position, float pixels_per_unit,
+	std::span<glm::vec3 const> centers, std::span<float const> radii, std::vector<std::uint32_t> & levels)
+{
+	std::uint32_t const coarsest = chain.levels.size() - 1;
+
+	levels.resize(centers.size(), 0);
+
+	// Pixels per model unit of error for every instance, at the nearest
+	// point of its bounding sphere
+	std::vector<float> scale(centers.size());
+	for (std::size_t i = 0; i < centers.size(); ++i)
+	{
+		float const distance = std::max(glm::distance(centers[i], camera_position) - radii[i], 1e-3f);
+		scale[i] = pixels_per_unit / distance;
+	}
+
+	std::vector<std::uint32_t> result(centers.size());
+
+	auto select = [&](float max_error)
+	{
+		std::size_t triangles = 0;
+		for (std::size_t i = 0; i < centers.size(); ++i)
+		{
+			auto projected = [&](std::uint32_t level){ return chain.levels[level].error * scale[i]; };
+
+			std::uint32_t level = std::min(levels[i], coarsest);
+
+			if (projected(level) > max_error * (1.f + settings.hysteresis))
+			{
+				// Too coarse: refine until the error is below the limit
+				while (level > 0 && projected(level) > max_error)
+					--level;
+			}
+			else
+			{
+				// Coarsen only once the error is well below the limit
+				while (level < coarsest && projected(level + 1) <= max_error * (1.f - settings.hysteresis))
+					++level;
+			}
+
+			result[i] = level;
+			triangles += chain.levels[level].triangles;
+		}
+		return triangles;
+	};
+
+	lod_stats stats;
+	stats.triangles = select(settings.max_error);
+
+	// Every step raises the limit by half, so the steps reach a limit more
+	// than 600 times the requested one
+	for (int step = 0; settings.triangle_budget > 0 && stats.triangles > settings.triangle_budget && step < 16; ++step)
+	{
+		stats.error_scale *= 1.5f;
+		stats.triangles = select(settings.max_error * stats.error_scale);
+	}
+
+	if (settings.triangle_budget > 0 && stats.triangles > settings.triangle_budget)
+	{
+		stats.error_scale = std::numeric_limits<float>::infinity();
+		stats.triangles = select(stats.error_scale);
+	}
+
+	levels = std::move(result);
+
+	stats.instances_per_level.assign(chain.levels.size(), 0);
+	for (std::uint32_t level : levels)
+		++stats.instances_per_level[level];
+
+	return stats;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Meshes of the same object at decreasing detail
+struct lod_chain
+{
+	struct level
+	{
+		std::uint32_t mesh;
+		std::uint32_t triangles;
+		// Geometric error in model units: glTF doesn't store one, so it is
+		// estimated as the typical edge length, sqrt(bounds area / triangles)
+		float error;
+	};
+
+	// From the most to the least detailed
+	std::vector<level> levels;
+
+	lod_chain() = default;
+	// Orders the meshes by triangle count
+	lod_chain(gltf_model const & model, std::vector<std::uint32_t> const & meshes);
+
+	// Index of the level that draws the mesh, if it is part of the chain
+	std::optional<std::uint32_t> level_of(std::uint32_t mesh) const;
+};
+
+struct lod_settings
+{
+	// Largest projected geometric error, in pixels
+	float max_error = 1.f;
+	// Relative width of the band around max_error where an instance keeps
+	// its level, so that it doesn't flip between two levels every frame
+	float hysteresis = 0.25f;
+	// Triangles per frame, 0 for no limit
+	std::size_t triangle_budget = 0;
+};
+
+struct lod_stats
+{
+	std::size_t triangles = 0;
+	// Factor that max_error was scaled by to meet the triangle budget
+	float error_scale = 1.f;
+	std::vector<std::size_t> instances_per_level;
+};
+
+// Picks a level for every instance, given by its world space bounding
+// sphere. `levels` holds the levels picked in the previous frame and is
+// updated; new instances should start at level 0. `pixels_per_unit` is the
+// projected size of an object of size 1 at distance 1, i.e.
+// viewport height / (2 tan(fov / 2)).
+//
+// If the budget is exceeded, the error limit of all instances is raised
+// until it is met or everything is at the coarsest level.
+lod_stats select_lods(lod_chain const & chain, lod_settings const & settings, glm::vec3 const & camera_position, float pixels_per_unit,
+	std::span<glm::vec3 const> centers, std::span<float const> radii, std::vector<std::uint32_t> & levels);
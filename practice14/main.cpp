@@ -16,6 +16,10 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <limits>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -30,6 +34,17 @@
 #include "aabb.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "culling_cache.hpp"
+#include "bounds.hpp"
+#include "occlusion.hpp"
+#include "occlusion_queries.hpp"
+#include "gpu_culling.hpp"
+#include "instanced_renderer.hpp"
+#include "thread_pool.hpp"
+#include "lod.hpp"
+#include "scene_graph.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -53,17 +68,41 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Where the model matrix comes from: 0 is the uniform, 1 the list of GPU
+// culling survivors for instanced draws of its results, 2 the per-instance
+// attributes of the instanced renderer
+uniform int model_source;
+uniform samplerBuffer instance_matrices;
+uniform usamplerBuffer instance_indices;
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+// Rows of the affine part of the model matrix
+layout (location = 3) in vec4 in_model_row0;
+layout (location = 4) in vec4 in_model_row1;
+layout (location = 5) in vec4 in_model_row2;
 
 out vec3 normal;
 out vec2 texcoord;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(in_position, 1.0);
-    normal = mat3(model) * in_normal;
+    mat4 model_matrix = model;
+    if (model_source == 1)
+    {
+        int base = 4 * int(texelFetch(instance_indices, gl_InstanceID).r);
+        model_matrix = mat4(
+            texelFetch(instance_matrices, base + 0),
+            texelFetch(instance_matrices, base + 1),
+            texelFetch(instance_matrices, base + 2),
+            texelFetch(instance_matrices, base + 3));
+    }
+    else if (model_source == 2)
+        model_matrix = transpose(mat4(in_model_row0, in_model_row1, in_model_row2, vec4(0.0, 0.0, 0.0, 1.0)));
+
+    gl_Position = projection * view * model_matrix * vec4(in_position, 1.0);
+    normal = mat3(model_matrix) * in_normal;
     texcoord = in_texcoord;
 }
 )";
@@ -91,6 +130,202 @@ void main()
 }
 )";
 
+const char fullscreen_vertex_shader_source[] =
+R"(#version 330 core
+
+const vec2 vertices[3] = vec2[3](
+    vec2(-1.0, -1.0),
+    vec2( 3.0, -1.0),
+    vec2(-1.0,  3.0)
+);
+
+void main()
+{
+    gl_Position = vec4(vertices[gl_VertexID], 0.0, 1.0);
+}
+)";
+
+const char depth_reduce_fragment_shader_source[] =
+R"(#version 330 core
+
+uniform sampler2D source;
+uniform int source_level;
+uniform ivec2 source_size;
+
+layout (location = 0) out float out_depth;
+
+void main()
+{
+    // The 2x2 block of the source, which is cut off at the last row or
+    // column of an odd sized source
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+
+    float depth = 0.0;
+    for (int y = 0; y < 2; ++y)
+        for (int x = 0; x < 2; ++x)
+            depth = max(depth, texelFetch(source, min(base + ivec2(x, y), source_size - 1), source_level).r);
+
+    out_depth = depth;
+}
+)";
+
+const char box_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 view_projection;
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+layout (location = 0) in vec3 in_position;
+
+void main()
+{
+    gl_Position = view_projection * vec4(mix(box_min, box_max, in_position), 1.0);
+}
+)";
+
+const char box_fragment_shader_source[] =
+R"(#version 330 core
+
+layout (location = 0) out vec4 out_color;
+
+void main()
+{
+    out_color = vec4(1.0);
+}
+)";
+
+const char cull_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform samplerBuffer instance_matrices;
+
+uniform vec4 planes[6];
+uniform vec3 bounds_min;
+uniform vec3 bounds_max;
+
+uniform vec3 camera_position;
+uniform float pixels_per_unit;
+uniform float max_error;
+uniform float lod_error[16];
+uniform int lod_count;
+
+// Depth pyramid of the previous frame
+uniform bool use_hi_z;
+uniform sampler2D hi_z;
+uniform mat4 hi_z_view_projection;
+uniform vec2 hi_z_screen_size;
+uniform int hi_z_levels;
+
+flat out int visible;
+flat out int level;
+flat out int instance;
+
+void main()
+{
+    int base = 4 * gl_VertexID;
+    mat4 model = mat4(
+        texelFetch(instance_matrices, base + 0),
+        texelFetch(instance_matrices, base + 1),
+        texelFetch(instance_matrices, base + 2),
+        texelFetch(instance_matrices, base + 3));
+
+    // World space bounds of the transformed box
+    vec3 half_size = (bounds_max - bounds_min) * 0.5;
+    vec3 center = (model * vec4((bounds_min + bounds_max) * 0.5, 1.0)).xyz;
+    vec3 extent = abs(model[0].xyz) * half_size.x + abs(model[1].xyz) * half_size.y + abs(model[2].xyz) * half_size.z;
+
+    visible = 1;
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w + dot(abs(planes[i].xyz), extent) < 0.0)
+            visible = 0;
+    }
+
+    if (use_hi_z && visible != 0)
+    {
+        // Screen rectangle and nearest depth of the box in the pyramid's
+        // frame; a box reaching behind the near plane counts as visible
+        vec3 window_min = vec3(1.0);
+        vec3 window_max = vec3(0.0);
+        bool clipped = false;
+        for (int i = 0; i < 8; ++i)
+        {
+            vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+            vec4 clip = hi_z_view_projection * vec4(corner, 1.0);
+            if (clip.z < -clip.w)
+                clipped = true;
+            vec3 window = clamp(clip.xyz / clip.w * 0.5 + 0.5, 0.0, 1.0);
+            window_min = min(window_min, window);
+            window_max = max(window_max, window);
+        }
+
+        if (!clipped)
+        {
+            // A texel of level l covers 2^(l+1) pixels, so at the level
+            // where the rectangle is at most one texel wide it touches at
+            // most 2x2 texels
+            vec2 pixel_min = window_min.xy * hi_z_screen_size;
+            vec2 pixel_max = window_max.xy * hi_z_screen_size;
+            vec2 size = pixel_max - pixel_min;
+            int hi_z_level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))) - 1, 0, hi_z_levels - 1);
+
+            ivec2 level_size = textureSize(hi_z, hi_z_level);
+            float texel_size = exp2(float(hi_z_level + 1));
+            ivec2 texel_min = clamp(ivec2(pixel_min / texel_size), ivec2(0), level_size - 1);
+            ivec2 texel_max = clamp(ivec2(pixel_max / texel_size), ivec2(0), level_size - 1);
+
+            float max_depth = 0.0;
+            for (int y = texel_min.y; y <= texel_max.y; ++y)
+                for (int x = texel_min.x; x <= texel_max.x; ++x)
+                    max_depth = max(max_depth, texelFetch(hi_z, ivec2(x, y), hi_z_level).r);
+
+            if (window_min.z > max_depth)
+                visible = 0;
+        }
+    }
+
+    // The coarsest level whose error projected at the nearest point of the
+    // bounding sphere is small enough
+    float distance = max(length(center - camera_position) - length(extent), 1e-3);
+    float scale = pixels_per_unit / distance;
+
+    level = 0;
+    for (int i = 1; i < lod_count; ++i)
+    {
+        if (lod_error[i] * scale <= max_error)
+            level = i;
+    }
+
+    instance = gl_VertexID;
+}
+)";
+
+const char cull_geometry_shader_source[] =
+R"(#version 330 core
+
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+uniform int lod_level;
+
+flat in int visible[];
+flat in int level[];
+flat in int instance[];
+
+flat out uint instance_index;
+
+void main()
+{
+    if (visible[0] != 0 && level[0] == lod_level)
+    {
+        instance_index = uint(instance[0]);
+        EmitVertex();
+        EndPrimitive();
+    }
+}
+)";
+
 GLuint create_shader(GLenum type, const char * source)
 {
     GLuint result = glCreateShader(type);
@@ -109,11 +344,8 @@ GLuint create_shader(GLenum type, const char * source)
     return result;
 }
 
-template <typename ... Shaders>
-GLuint create_program(Shaders ... shaders)
+GLuint link_program(GLuint result)
 {
-    GLuint result = glCreateProgram();
-    (glAttachShader(result, shaders), ...);
     glLinkProgram(result);
 
     GLint status;
@@ -130,6 +362,24 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
+template <typename ... Shaders>
+GLuint create_program(Shaders ... shaders)
+{
+    GLuint result = glCreateProgram();
+    (glAttachShader(result, shaders), ...);
+    return link_program(result);
+}
+
+// The varyings to capture must be set before linking
+template <typename ... Shaders>
+GLuint create_transform_feedback_program(const char * varying, Shaders ... shaders)
+{
+    GLuint result = glCreateProgram();
+    (glAttachShader(result, shaders), ...);
+    glTransformFeedbackVaryings(result, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+    return link_program(result);
+}
+
 int main() try
 {
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -181,10 +431,31 @@ int main() try
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
     GLuint bones_location = glGetUniformLocation(program, "bones");
 
+    auto box_vertex_shader = create_shader(GL_VERTEX_SHADER, box_vertex_shader_source);
+    auto box_fragment_shader = create_shader(GL_FRAGMENT_SHADER, box_fragment_shader_source);
+    auto box_program = create_program(box_vertex_shader, box_fragment_shader);
+
+    GLuint model_source_location = glGetUniformLocation(program, "model_source");
+    GLint const model_from_uniform = 0;
+    GLint const model_from_culling = 1;
+    GLint const model_from_attributes = 2;
+    GLuint instance_matrices_location = glGetUniformLocation(program, "instance_matrices");
+    GLuint instance_indices_location = glGetUniformLocation(program, "instance_indices");
+
+    auto cull_vertex_shader = create_shader(GL_VERTEX_SHADER, cull_vertex_shader_source);
+    auto cull_geometry_shader = create_shader(GL_GEOMETRY_SHADER, cull_geometry_shader_source);
+    auto cull_program = create_transform_feedback_program("instance_index", cull_vertex_shader, cull_geometry_shader);
+
+    auto fullscreen_vertex_shader = create_shader(GL_VERTEX_SHADER, fullscreen_vertex_shader_source);
+    auto depth_reduce_fragment_shader = create_shader(GL_FRAGMENT_SHADER, depth_reduce_fragment_shader_source);
+    auto depth_reduce_program = create_program(fullscreen_vertex_shader, depth_reduce_fragment_shader);
+
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/bunny/bunny.gltf";
 
     auto const input_model = load_gltf(model_path);
+
+    scene_graph scene(input_model.nodes);
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -202,7 +473,7 @@ int main() try
         auto setup_attribute = [](int index, gltf_model::accessor const & accessor)
         {
             glEnableVertexAttribArray(index);
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribPointer(index, accessor.size, accessor.type, accessor.normalized ? GL_TRUE : GL_FALSE, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
         };
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -213,6 +484,45 @@ int main() try
         vaos.push_back(vao);
     }
 
+    // Draws the visible nodes, and the field of bunnies
+    instanced_renderer instancing(vaos, 3);
+
+    // CPU copies of the meshes for the occlusion rasterizer
+    struct occluder_mesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<std::uint32_t> indices;
+    };
+
+    std::vector<occluder_mesh> occluders;
+    for (auto const & mesh : input_model.meshes)
+    {
+        auto & occluder = occluders.emplace_back();
+
+        // Quantized meshes are simply not used as occluders
+        if (mesh.position.type != GL_FLOAT) continue;
+
+        std::size_t const position_stride = mesh.position.view.stride ? mesh.position.view.stride : sizeof(glm::vec3);
+        occluder.positions.resize(mesh.position.count);
+        for (std::size_t i = 0; i < mesh.position.count; ++i)
+            std::memcpy(&occluder.positions[i], input_model.buffer.data() + mesh.position.view.offset + i * position_stride, sizeof(glm::vec3));
+
+        auto const index_data = input_model.buffer.data() + mesh.indices.view.offset;
+        occluder.indices.resize(mesh.indices.count);
+        for (std::size_t i = 0; i < mesh.indices.count; ++i)
+        {
+            if (mesh.indices.type == GL_UNSIGNED_BYTE)
+                occluder.indices[i] = reinterpret_cast<std::uint8_t const *>(index_data)[i];
+            else if (mesh.indices.type == GL_UNSIGNED_SHORT)
+                occluder.indices[i] = reinterpret_cast<std::uint16_t const *>(index_data)[i];
+            else
+                occluder.indices[i] = reinterpret_cast<std::uint32_t const *>(index_data)[i];
+        }
+    }
+
+    thread_pool pool;
+    occlusion_buffer occlusion;
+
     GLuint texture;
     {
         auto const & mesh = input_model.meshes[0];
@@ -243,6 +553,115 @@ int main() try
     float camera_rotation = 0.f;
 
     bool paused = false;
+    // O switches between the software occlusion buffer and hardware
+    // occlusion queries
+    bool use_occlusion_queries = false;
+    // G moves frustum culling and LOD selection to the GPU, with no
+    // occlusion culling
+    bool use_gpu_culling = false;
+    // H toggles the GPU occlusion test against the previous frame's depth
+    bool use_hi_z = true;
+    // I replaces the scene with a field of bunnies, far more than the scene
+    // has nodes, culled on the CPU and drawn by the instanced renderer
+    bool show_field = false;
+
+    // All meshes of the model are the same bunny at decreasing detail; every
+    // node draws the level that suits its distance, starting from its own
+    std::vector<std::uint32_t> lod_meshes(input_model.meshes.size());
+    std::iota(lod_meshes.begin(), lod_meshes.end(), 0);
+    lod_chain const bunny_lods(input_model, lod_meshes);
+
+    lod_settings lod_options;
+    lod_options.triangle_budget = 8000;
+
+    // Nodes are bounded by all levels, so that switching levels doesn't
+    // change the culling
+    glm::vec3 lod_min(std::numeric_limits<float>::infinity());
+    glm::vec3 lod_max(-std::numeric_limits<float>::infinity());
+    for (auto const & level : bunny_lods.levels)
+    {
+        lod_min = glm::min(lod_min, input_model.meshes[level.mesh].min);
+        lod_max = glm::max(lod_max, input_model.meshes[level.mesh].max);
+    }
+
+    // Tighter bounds of all levels fitted from their vertices: the oriented
+    // box rejects what the world space box lets through, the sphere is the
+    // size for LOD selection
+    std::vector<glm::vec3> lod_points;
+    for (auto const & level : bunny_lods.levels)
+        lod_points.insert(lod_points.end(), occluders[level.mesh].positions.begin(), occluders[level.mesh].positions.end());
+    if (lod_points.empty())
+    {
+        // Quantized meshes have no CPU copy, so there are only their boxes
+        lod_points = {lod_min, lod_max};
+    }
+    obb const lod_obb = fit_obb(lod_points);
+    bounding_sphere const lod_sphere = fit_sphere(lod_points);
+    lod_points.clear();
+
+    // World bounds of the nodes with meshes, recomputed every frame
+    std::vector<std::uint32_t> mesh_nodes;
+    std::vector<std::uint32_t> node_levels;
+    box_set node_boxes;
+    for (std::uint32_t node = 0; node < scene.size(); ++node)
+    {
+        auto const & mesh_index = input_model.nodes[scene.source_node[node]].mesh;
+        if (!mesh_index) continue;
+
+        auto const [min, max] = transform_bounds(scene.world_matrix[node], lod_min, lod_max);
+        mesh_nodes.push_back(node);
+        node_levels.push_back(*bunny_lods.level_of(*mesh_index));
+        node_boxes.push_back(min, max);
+    }
+
+    bvh node_bvh(node_boxes);
+    std::vector<std::uint32_t> moved_nodes;
+    culling_cache node_culling;
+    occlusion_queries hardware_occlusion(box_program, mesh_nodes.size());
+    gpu_culling instance_culling(cull_program, bunny_lods, lod_min, lod_max);
+    std::vector<glm::mat4> instance_matrices;
+    depth_pyramid hi_z(depth_reduce_program);
+    std::vector<std::uint32_t> visible;
+
+    // Small bunnies turned at random on a grid around the origin
+    std::vector<glm::mat4> field_matrices;
+    sphere_set field_spheres;
+    std::vector<std::uint32_t> field_levels;
+    std::vector<std::uint32_t> field_visible;
+    {
+        int const field_size = 400;
+        float const spacing = 0.3f;
+
+        std::mt19937 rng;
+        std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+
+        for (int x = 0; x < field_size; ++x)
+        {
+            for (int z = 0; z < field_size; ++z)
+            {
+                glm::mat4 m = glm::translate(glm::mat4(1.f), {(x - 0.5f * field_size) * spacing, 0.f, (z - 0.5f * field_size) * spacing});
+                m = glm::rotate(m, angle(rng), {0.f, 1.f, 0.f});
+                m = glm::scale(m, glm::vec3(0.25f));
+
+                field_matrices.push_back(m);
+                field_spheres.push_back(transform(m, lod_sphere));
+            }
+        }
+        field_levels.assign(field_matrices.size(), 0);
+    }
+
+    // A hundred thousand bunnies at the coarsest level alone are some 18M
+    // triangles, so the field gets a budget of its own that still leaves
+    // the closest ones some detail
+    lod_settings field_lod_options = lod_options;
+    field_lod_options.triangle_budget = 20000000;
+
+    std::vector<glm::mat4> node_matrices;
+    std::vector<glm::vec3> visible_centers;
+    std::vector<float> visible_radii;
+    std::vector<std::uint32_t> visible_levels;
+
+    float last_stats_time = 0.f;
 
     bool running = true;
     while (running)
@@ -265,6 +684,14 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_o)
+                use_occlusion_queries = !use_occlusion_queries;
+            if (event.key.keysym.sym == SDLK_g)
+                use_gpu_culling = !use_gpu_culling;
+            if (event.key.keysym.sym == SDLK_h)
+                use_hi_z = !use_hi_z;
+            if (event.key.keysym.sym == SDLK_i)
+                show_field = !show_field;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -316,8 +743,6 @@ int main() try
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model(1.f);
-
         glm::mat4 view(1.f);
         view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
         view = glm::translate(view, -camera_position);
@@ -328,18 +753,239 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
+        scene.update();
+
+        float const pixels_per_unit = height / (2.f * std::tan(glm::pi<float>() / 4.f));
+        bool const print_stats = (time - last_stats_time > 1.f);
+        if (print_stats)
+            last_stats_time = time;
+
+        if (use_gpu_culling && !show_field)
+        {
+            instance_matrices.clear();
+            for (std::uint32_t node : mesh_nodes)
+                instance_matrices.push_back(scene.world_matrix[node]);
+
+            instance_culling.update_instances(instance_matrices);
+            instance_culling.cull(projection * view, camera_position, pixels_per_unit, lod_options, use_hi_z ? &hi_z : nullptr);
+        }
+
         glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
 
+        glUniform1i(albedo_location, 0);
+        glUniform1i(instance_matrices_location, 1);
+        glUniform1i(instance_indices_location, 2);
+        glUniform1i(model_source_location, model_from_uniform);
+
         glBindTexture(GL_TEXTURE_2D, texture);
 
+        if (show_field)
+        {
+            auto const cpu_start = std::chrono::high_resolution_clock::now();
+
+            field_visible.clear();
+            cull_spheres(frustum_planes(projection * view), field_spheres, field_visible);
+
+            visible_centers.clear();
+            visible_radii.clear();
+            visible_levels.clear();
+            for (std::uint32_t i : field_visible)
+            {
+                visible_centers.push_back({field_spheres.center_x[i], field_spheres.center_y[i], field_spheres.center_z[i]});
+                visible_radii.push_back(field_spheres.radius[i]);
+                visible_levels.push_back(field_levels[i]);
+            }
+
+            auto const lod_result = select_lods(bunny_lods, field_lod_options, camera_position, pixels_per_unit, visible_centers, visible_radii, visible_levels);
+
+            for (std::size_t v = 0; v < field_visible.size(); ++v)
+                field_levels[field_visible[v]] = visible_levels[v];
+
+            glUniform1i(model_source_location, model_from_attributes);
+            auto const draw_result = instancing.draw(input_model, bunny_lods, field_matrices, field_levels, field_visible);
+
+            std::chrono::duration<double> const cpu_time = std::chrono::high_resolution_clock::now() - cpu_start;
+
+            if (print_stats)
+            {
+                std::cout << "Field: " << draw_result.instances << " of " << field_matrices.size() << " instances in " << draw_result.draws
+                    << " draws, triangles: " << draw_result.triangles << ", CPU: " << cpu_time.count() * 1e3 << " ms, instances per LOD:";
+                for (auto count : lod_result.instances_per_level)
+                    std::cout << ' ' << count;
+                std::cout << std::endl;
+            }
+
+            SDL_GL_SwapWindow(window);
+            continue;
+        }
+
+        if (use_gpu_culling)
+        {
+            // The CPU doesn't look at the nodes at all, the latest culling
+            // results are drawn with one instanced call per level
+            glUniform1i(model_source_location, model_from_culling);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, instance_culling.matrices());
+            glActiveTexture(GL_TEXTURE2);
+
+            std::size_t instances = 0;
+            for (auto const & batch : instance_culling.batches())
+            {
+                if (batch.count == 0) continue;
+                instances += batch.count;
+
+                auto const mesh_index = bunny_lods.levels[batch.level].mesh;
+                auto const & mesh = input_model.meshes[mesh_index];
+
+                glBindTexture(GL_TEXTURE_BUFFER, batch.indices);
+                glBindVertexArray(vaos[mesh_index]);
+                glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset), batch.count);
+            }
+
+            glActiveTexture(GL_TEXTURE0);
+
+            // Occluders for the next frame's culling
+            if (use_hi_z)
+                hi_z.update(width, height, projection * view);
+
+            if (print_stats)
+            {
+                std::cout << "GPU culling" << (use_hi_z ? " with Hi-Z" : "") << ": " << instances << " instances, per LOD:";
+                for (auto const & batch : instance_culling.batches())
+                    std::cout << ' ' << batch.count;
+                std::cout << std::endl;
+            }
+
+            SDL_GL_SwapWindow(window);
+            continue;
+        }
+
+        // The hierarchy rejects whole groups of nodes at once, the exact test
+        // only runs on the ones that pass the plane tests, and mostly reuses
+        // the previous frame's results
+        node_boxes.clear();
+        moved_nodes.clear();
+        for (std::uint32_t i = 0; i < mesh_nodes.size(); ++i)
+        {
+            auto const [min, max] = transform_bounds(scene.world_matrix[mesh_nodes[i]], lod_min, lod_max);
+            node_boxes.push_back(min, max);
+            // The tree holds the boxes as the box set stores them, which
+            // doesn't always give back the exact corners it was given
+            if (node_boxes.min(i) != node_bvh.object_min[i] || node_boxes.max(i) != node_bvh.object_max[i])
+                moved_nodes.push_back(i);
+        }
+
+        // Walking up from every moved node gets more expensive than one pass
+        // over the whole tree once more than a few of them have moved
+        if (moved_nodes.size() * 8 > mesh_nodes.size())
+        {
+            for (auto i : moved_nodes)
+            {
+                node_bvh.object_min[i] = node_boxes.min(i);
+                node_bvh.object_max[i] = node_boxes.max(i);
+            }
+            node_bvh.refit();
+        }
+        else
+        {
+            for (auto i : moved_nodes)
+                node_bvh.update(i, node_boxes.min(i), node_boxes.max(i));
+        }
+
+        visible.clear();
+        node_bvh.cull(frustum_planes(projection * view), visible);
+        auto const culling_result = node_culling.refine(frustum(projection * view), node_boxes, visible);
+
+        // The world space boxes of rotated nodes are loose, their oriented
+        // boxes reject some more
+        std::size_t const aabb_visible = visible.size();
+        frustum const view_frustum(projection * view);
+        visible.erase(std::remove_if(visible.begin(), visible.end(), [&](std::uint32_t i)
+        {
+            return !intersect(transform(scene.world_matrix[mesh_nodes[i]], lod_obb), view_frustum);
+        }), visible.end());
+        std::size_t const obb_rejected = aabb_visible - visible.size();
+
+        // The visible meshes themselves are the occluders. A mesh lies inside
+        // its own box, so it never hides itself. The occlusion queries decide
+        // while drawing instead
+        if (!use_occlusion_queries)
+        {
+            occlusion.clear();
+            for (std::uint32_t i : visible)
+            {
+                std::uint32_t const node = mesh_nodes[i];
+                auto const & occluder = occluders[bunny_lods.levels[node_levels[i]].mesh];
+                occlusion.draw_occluder(projection * view * scene.world_matrix[node], occluder.positions, occluder.indices, &pool);
+            }
+            occlusion.build_hierarchy();
+
+            visible.erase(std::remove_if(visible.begin(), visible.end(), [&](std::uint32_t i)
+            {
+                return !occlusion.visible(projection * view, node_boxes.min(i), node_boxes.max(i));
+            }), visible.end());
+        }
+
+        // Levels of the visible nodes, the hidden ones keep theirs until
+        // they show up again
+        visible_centers.clear();
+        visible_radii.clear();
+        visible_levels.clear();
+        for (std::uint32_t i : visible)
+        {
+            auto const sphere = transform(scene.world_matrix[mesh_nodes[i]], lod_sphere);
+            visible_centers.push_back(sphere.center);
+            visible_radii.push_back(sphere.radius);
+            visible_levels.push_back(node_levels[i]);
+        }
+
+        auto const lod_result = select_lods(bunny_lods, lod_options, camera_position, pixels_per_unit, visible_centers, visible_radii, visible_levels);
+
+        for (std::size_t v = 0; v < visible.size(); ++v)
+            node_levels[visible[v]] = visible_levels[v];
+
+        if (print_stats)
         {
-            auto const & mesh = input_model.meshes[0];
-            glBindVertexArray(vaos[0]);
+            std::cout << "Visible nodes: " << visible.size() << ", axes per exact test: " << culling_result.average_axes()
+                << ", rejected by OBB: " << obb_rejected
+                << ", triangles: " << lod_result.triangles
+                << ", error scale: " << lod_result.error_scale << ", nodes per LOD:";
+            for (auto count : lod_result.instances_per_level)
+                std::cout << ' ' << count;
+            std::cout << std::endl;
+        }
+
+        auto draw_node = [&](std::uint32_t i)
+        {
+            std::uint32_t const node = mesh_nodes[i];
+            auto const mesh_index = bunny_lods.levels[node_levels[i]].mesh;
+
+            glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float const *>(&scene.world_matrix[node]));
+
+            auto const & mesh = input_model.meshes[mesh_index];
+            glBindVertexArray(vaos[mesh_index]);
             glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+        };
+
+        if (use_occlusion_queries)
+        {
+            auto const query_result = hardware_occlusion.render(projection * view, node_boxes, visible, draw_node);
+            if (print_stats)
+                std::cout << "Occlusion queries: drawn " << query_result.drawn << ", skipped " << query_result.skipped
+                    << ", retested " << query_result.tested << std::endl;
+        }
+        else
+        {
+            // One draw per level instead of one per node
+            node_matrices.clear();
+            for (std::uint32_t node : mesh_nodes)
+                node_matrices.push_back(scene.world_matrix[node]);
+
+            glUniform1i(model_source_location, model_from_attributes);
+            instancing.draw(input_model, bunny_lods, node_matrices, node_levels, visible);
         }
 
         SDL_GL_SwapWindow(window);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+// Decoders for buffer views compressed with the EXT_meshopt_compression glTF
+// extension. The bitstreams are the ones produced by meshoptimizer: vertex
+// codec version 0, index codec versions 0 and 1, index sequence version 0.
+// All functions throw std::runtime_error on malformed or unsupported data.
+
+// Mode ATTRIBUTES: count elements of the given stride (a multiple of 4, at most 256 bytes)
+void meshopt_decode_vertex_buffer(void * destination, std::size_t count, std::size_t stride, unsigned char const * data, std::size_t size);
+
+// Mode TRIANGLES: count indices (a multiple of 3) of 2 or 4 bytes each
+void meshopt_decode_index_buffer(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size);
+
+// Mode INDICES: count indices of 2 or 4 bytes each
+void meshopt_decode_index_sequence(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size);
+
+// Filters are applied in place to decoded ATTRIBUTES data
+
+// Octahedral normals or tangents: 4 signed bytes or shorts per element (stride 4 or 8)
+void meshopt_decode_filter_oct(void * data, std::size_t count, std::size_t stride);
+
+// Quaternions stored as three smallest components: 4 shorts per element (stride 8)
+void meshopt_decode_filter_quat(void * data, std::size_t count, std::size_t stride);
+
+// Floats stored as 8-bit exponent and 24-bit mantissa: stride is a multiple of 4
+void meshopt_decode_filter_exp(void * data, std::size_t count, std::size_t stride);
@@ -0,0 +1,327 @@
+#include "occlusion.hpp"
+
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#endif
+
+namespace
+{
+
+// A screen-space triangle prepared for rasterization: three edge functions
+// and the depth plane, all of the form a * x + b * y + c
+struct triangle
+{
+	std::array<float, 3> edge_a, edge_b, edge_c;
+	float depth_a, depth_b, depth_c;
+	int min_x, max_x, min_y, max_y;
+};
+
+}
+
+occlusion_buffer::occlusion_buffer(int width, int height)
+{
+	if (width <= 0 || height <= 0 || width % 8 != 0)
+		throw std::runtime_error("Occlusion buffer width must be a positive multiple of 8");
+
+	while (true)
+	{
+		levels.push_back({width, height, std::vector<float>(width * height, 1.f)});
+		if (width == 1 && height == 1)
+			break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+}
+
+void occlusion_buffer::clear()
+{
+	std::fill(levels[0].max_depth.begin(), levels[0].max_depth.end(), 1.f);
+}
+
+// Sets up the triangle with window-space vertices (x, y in pixels, z in
+// [0, 1]); returns false for back faces and triangles that cover no pixel
+// centers of the buffer
+static bool setup_triangle(glm::vec3 const & v0, glm::vec3 const & v1, glm::vec3 const & v2, int width, int height, triangle & result)
+{
+	float const area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (!(area > 0.f))
+		return false;
+
+	// Pixel centers are at half-integer coordinates
+	result.min_x = std::max(0, static_cast<int>(std::ceil(std::min({v0.x, v1.x, v2.x}) - 0.5f)));
+	result.max_x = std::min(width - 1, static_cast<int>(std::floor(std::max({v0.x, v1.x, v2.x}) - 0.5f)));
+	result.min_y = std::max(0, static_cast<int>(std::ceil(std::min({v0.y, v1.y, v2.y}) - 0.5f)));
+	result.max_y = std::min(height - 1, static_cast<int>(std::floor(std::max({v0.y, v1.y, v2.y}) - 0.5f)));
+	if (result.min_x > result.max_x || result.min_y > result.max_y)
+		return false;
+
+	// Edge i is opposite to vertex i and is positive on the inner side
+	glm::vec3 const v[3] = {v0, v1, v2};
+	for (int i = 0; i < 3; ++i)
+	{
+		auto const & a = v[(i + 1) % 3];
+		auto const & b = v[(i + 2) % 3];
+		result.edge_a[i] = a.y - b.y;
+		result.edge_b[i] = b.x - a.x;
+		result.edge_c[i] = a.x * b.y - a.y * b.x;
+	}
+
+	// Window depth is linear in screen space: the edge functions divided by
+	// the area are the barycentric coordinates
+	result.depth_a = result.depth_b = result.depth_c = 0.f;
+	for (int i = 0; i < 3; ++i)
+	{
+		float const w = v[i].z / area;
+		result.depth_a += result.edge_a[i] * w;
+		result.depth_b += result.edge_b[i] * w;
+		result.depth_c += result.edge_c[i] * w;
+	}
+
+	// Only texels the triangle covers entirely are written: a texel is
+	// several screen pixels wide, and a box that shows past the silhouette
+	// of an occluder by less than that mustn't be hidden. Moving every edge
+	// inwards by its largest change from the texel center to a corner
+	// makes the center test an inside test for the whole texel; the depth
+	// is the farthest one the triangle has within the texel
+	for (int i = 0; i < 3; ++i)
+		result.edge_c[i] -= 0.5f * (std::abs(result.edge_a[i]) + std::abs(result.edge_b[i]));
+	result.depth_c += 0.5f * (std::abs(result.depth_a) + std::abs(result.depth_b));
+
+	return true;
+}
+
+static void rasterize(triangle const & t, float * depth, int width, int row_begin, int row_end)
+{
+	int const min_y = std::max(t.min_y, row_begin);
+	int const max_y = std::min(t.max_y, row_end - 1);
+
+	for (int y = min_y; y <= max_y; ++y)
+	{
+		float const py = y + 0.5f;
+		float * row = depth + y * width;
+
+		float row_edge[3];
+		for (int i = 0; i < 3; ++i)
+			row_edge[i] = t.edge_b[i] * py + t.edge_c[i];
+		float const row_depth = t.depth_b * py + t.depth_c;
+
+#ifdef OCCLUSION_AVX2
+		__m256 const lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256i const lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+		// Whole groups of 8 pixels, the lanes outside the bounding box are
+		// masked out like the ones outside the triangle
+		for (int x = t.min_x & ~7; x <= t.max_x; x += 8)
+		{
+			__m256 const px = _mm256_add_ps(_mm256_set1_ps(x), lane);
+			__m256i const pixel = _mm256_add_epi32(_mm256_set1_epi32(x), lane_index);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_and_si256(
+				_mm256_cmpgt_epi32(pixel, _mm256_set1_epi32(t.min_x - 1)),
+				_mm256_cmpgt_epi32(_mm256_set1_epi32(t.max_x + 1), pixel)));
+
+			for (int i = 0; i < 3; ++i)
+			{
+				__m256 const e = _mm256_fmadd_ps(_mm256_set1_ps(t.edge_a[i]), px, _mm256_set1_ps(row_edge[i]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			if (_mm256_testz_ps(inside, inside))
+				continue;
+
+			__m256 const z = _mm256_fmadd_ps(_mm256_set1_ps(t.depth_a), px, _mm256_set1_ps(row_depth));
+			__m256 const old_z = _mm256_loadu_ps(row + x);
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(old_z, _mm256_min_ps(old_z, z), inside));
+		}
+#else
+		for (int x = t.min_x; x <= t.max_x; ++x)
+		{
+			float const px = x + 0.5f;
+			if (t.edge_a[0] * px + row_edge[0] < 0.f) continue;
+			if (t.edge_a[1] * px + row_edge[1] < 0.f) continue;
+			if (t.edge_a[2] * px + row_edge[2] < 0.f) continue;
+
+			float const z = t.depth_a * px + row_depth;
+			row[x] = std::min(row[x], z);
+		}
+#endif
+	}
+}
+
+void occlusion_buffer::draw_occluder(glm::mat4 const & transform, std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices, thread_pool * pool)
+{
+	int const w = width();
+	int const h = height();
+
+	std::vector<glm::vec4> clip(positions.size());
+	for (std::size_t i = 0; i < positions.size(); ++i)
+		clip[i] = transform * glm::vec4(positions[i], 1.f);
+
+	auto to_window = [&](glm::vec4 const & v)
+	{
+		return glm::vec3((v.x / v.w * 0.5f + 0.5f) * w, (v.y / v.w * 0.5f + 0.5f) * h, v.z / v.w * 0.5f + 0.5f);
+	};
+
+	std::vector<triangle> triangles;
+	triangles.reserve(indices.size() / 3);
+
+	auto add_triangle = [&](glm::vec4 const & a, glm::vec4 const & b, glm::vec4 const & c)
+	{
+		triangle t;
+		if (setup_triangle(to_window(a), to_window(b), to_window(c), w, h, t))
+			triangles.push_back(t);
+	};
+
+	for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec4 const v[3] = {clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]};
+
+		// Signed distances to the near plane z = -w, positive in front of it
+		float const d[3] = {v[0].z + v[0].w, v[1].z + v[1].w, v[2].z + v[2].w};
+		if (d[0] >= 0.f && d[1] >= 0.f && d[2] >= 0.f)
+		{
+			add_triangle(v[0], v[1], v[2]);
+			continue;
+		}
+		if (d[0] < 0.f && d[1] < 0.f && d[2] < 0.f)
+			continue;
+
+		// Clip against the near plane, which leaves a triangle or a quad
+		glm::vec4 polygon[4];
+		int count = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			int const k = (j + 1) % 3;
+			if (d[j] >= 0.f)
+				polygon[count++] = v[j];
+			if ((d[j] >= 0.f) != (d[k] >= 0.f))
+				polygon[count++] = glm::mix(v[j], v[k], d[j] / (d[j] - d[k]));
+		}
+
+		for (int j = 1; j + 1 < count; ++j)
+			add_triangle(polygon[0], polygon[j], polygon[j + 1]);
+	}
+
+	float * depth = levels[0].max_depth.data();
+
+	if (!pool)
+	{
+		for (auto const & t : triangles)
+			rasterize(t, depth, w, 0, h);
+		return;
+	}
+
+	// Every band is written by one thread only, so no synchronization is
+	// needed; thin bands balance the load of triangles covering a part of
+	// the screen
+	int const band_height = std::max<int>(4, h / (pool->size() * 4));
+	int const band_count = (h + band_height - 1) / band_height;
+
+	pool->parallel_for(band_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t band = begin; band < end; ++band)
+		{
+			int const row_begin = band * band_height;
+			int const row_end = std::min<int>(h, row_begin + band_height);
+			for (auto const & t : triangles)
+				if (t.max_y >= row_begin && t.min_y < row_end)
+					rasterize(t, depth, w, row_begin, row_end);
+		}
+	});
+}
+
+void occlusion_buffer::build_hierarchy()
+{
+	for (std::size_t l = 1; l < levels.size(); ++l)
+	{
+		auto const & source = levels[l - 1];
+		auto & target = levels[l];
+
+		for (int y = 0; y < target.height; ++y)
+		{
+			int const y0 = 2 * y;
+			int const y1 = std::min(2 * y + 1, source.height - 1);
+
+			for (int x = 0; x < target.width; ++x)
+			{
+				int const x0 = 2 * x;
+				int const x1 = std::min(2 * x + 1, source.width - 1);
+
+				target.max_depth[y * target.width + x] = std::max({
+					source.max_depth[y0 * source.width + x0],
+					source.max_depth[y0 * source.width + x1],
+					source.max_depth[y1 * source.width + x0],
+					source.max_depth[y1 * source.width + x1],
+				});
+			}
+		}
+	}
+}
+
+bool occlusion_buffer::visible(glm::mat4 const & view_projection, glm::vec3 const & min, glm::vec3 const & max) const
+{
+	glm::vec3 window_min(std::numeric_limits<float>::infinity());
+	glm::vec3 window_max(-std::numeric_limits<float>::infinity());
+
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec4 const corner = view_projection * glm::vec4(
+			(i & 1) ? max.x : min.x,
+			(i & 2) ? max.y : min.y,
+			(i & 4) ? max.z : min.z,
+			1.f);
+
+		if (corner.z < -corner.w)
+			return true;
+
+		glm::vec3 const ndc = glm::vec3(corner) / corner.w;
+		window_min = glm::min(window_min, ndc);
+		window_max = glm::max(window_max, ndc);
+	}
+
+	window_min = window_min * 0.5f + 0.5f;
+	window_max = window_max * 0.5f + 0.5f;
+
+	// Every pixel whose area the rectangle touches, not only their centers
+	int x0 = std::max(0, static_cast<int>(std::floor(window_min.x * width())));
+	int x1 = std::min(width() - 1, static_cast<int>(std::floor(window_max.x * width())));
+	int y0 = std::max(0, static_cast<int>(std::floor(window_min.y * height())));
+	int y1 = std::min(height() - 1, static_cast<int>(std::floor(window_max.y * height())));
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	std::size_t l = 0;
+	while (l + 1 < levels.size() && (x1 - x0 > 1 || y1 - y0 > 1))
+	{
+		x0 /= 2; x1 /= 2;
+		y0 /= 2; y1 /= 2;
+		++l;
+	}
+
+	auto const & level = levels[l];
+	for (int y = y0; y <= y1; ++y)
+		for (int x = x0; x <= x1; ++x)
+			if (window_min.z <= level.max_depth[y * level.width + x])
+				return true;
+
+	return false;
+}
+
+bool occlusion_simd_enabled()
+{
+#ifdef OCCLUSION_AVX2
+	return true;
+#else
+	return false;
+#endif
+}
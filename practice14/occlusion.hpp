@@ -0,0 +1,56 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A small CPU depth buffer for occlusion culling.
+//
+// A few large occluders are rasterized into it at low resolution, depth
+// only; then a pyramid of maximal depths is built on top of it. A candidate
+// box is hidden when its nearest point is behind the farthest occluder depth
+// of every pyramid texel its screen rectangle touches, which takes just a
+// few reads at a pyramid level where the rectangle is at most 2x2 texels.
+//
+// Depths are window depths in [0, 1], 1 where no occluder was drawn.
+struct occlusion_buffer
+{
+	struct level
+	{
+		int width;
+		int height;
+		std::vector<float> max_depth;
+	};
+
+	// Level 0 is the depth buffer itself, every next level halves the size
+	std::vector<level> levels;
+
+	// The width must be a multiple of 8, the SIMD rasterizer works on 8
+	// pixels of a row at once
+	explicit occlusion_buffer(int width = 256, int height = 128);
+
+	int width() const { return levels[0].width; }
+	int height() const { return levels[0].height; }
+
+	void clear();
+
+	// Rasterizes the triangles, which are counter-clockwise when seen from
+	// the front; back faces are skipped. Only the texels a triangle covers
+	// entirely are written, with its farthest depth over them. With a pool,
+	// horizontal bands of the buffer are rasterized in parallel
+	void draw_occluder(glm::mat4 const & transform, std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices, thread_pool * pool = nullptr);
+
+	// Must be called after the occluders are drawn and before testing
+	void build_hierarchy();
+
+	// Whether any part of the box may be in front of the occluders. Boxes
+	// crossing the near plane are always visible
+	bool visible(glm::mat4 const & view_projection, glm::vec3 const & min, glm::vec3 const & max) const;
+};
+
+bool occlusion_simd_enabled();
@@ -0,0 +1,188 @@
+// Headless occlusion culling benchmark: rasterizes a few walls into the CPU
+// depth buffer, single-threaded and on a thread pool, and tests a hundred
+// thousand boxes scattered around and behind them. The hierarchical test is
+// checked against the full resolution depth buffer, and the boxes it hides
+// against the walls themselves.
+
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include "benchmark.hpp"
+#include "occlusion.hpp"
+#include "thread_pool.hpp"
+
+// Whether the segment from the origin to the target crosses one of the
+// triangles before reaching the target
+static bool occluded(glm::vec3 const & origin, glm::vec3 const & target, std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices)
+{
+    glm::vec3 const direction = target - origin;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        // Moller-Trumbore, with the hit parameter along the segment
+        glm::vec3 const v0 = positions[indices[i]];
+        glm::vec3 const e1 = positions[indices[i + 1]] - v0;
+        glm::vec3 const e2 = positions[indices[i + 2]] - v0;
+
+        glm::vec3 const p = glm::cross(direction, e2);
+        float const det = glm::dot(e1, p);
+        if (std::abs(det) < 1e-12f) continue;
+
+        glm::vec3 const s = origin - v0;
+        float const u = glm::dot(s, p) / det;
+        if (u < 0.f || u > 1.f) continue;
+
+        glm::vec3 const q = glm::cross(s, e1);
+        float const v = glm::dot(direction, q) / det;
+        if (v < 0.f || u + v > 1.f) continue;
+
+        // Points lying on an occluder's surface don't count as behind it
+        float const t = glm::dot(e2, q) / det;
+        if (t > 0.f && t < 1.f - 1e-4f)
+            return true;
+    }
+    return false;
+}
+
+// A closed box mesh with counter-clockwise front faces
+static void add_box(glm::vec3 const & min, glm::vec3 const & max, std::vector<glm::vec3> & positions, std::vector<std::uint32_t> & indices)
+{
+    std::uint32_t const base = positions.size();
+    for (int i = 0; i < 8; ++i)
+        positions.push_back({(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z});
+
+    std::uint32_t const faces[6][4] = {
+        {0, 4, 6, 2}, {1, 3, 7, 5},
+        {0, 1, 5, 4}, {2, 6, 7, 3},
+        {0, 2, 3, 1}, {4, 5, 7, 6},
+    };
+
+    for (auto const & f : faces)
+        for (std::uint32_t i : {f[0], f[1], f[2], f[0], f[2], f[3]})
+            indices.push_back(base + i);
+}
+
+int main()
+{
+    // Walls of different heights across the view, some of them close
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    add_box({-30.f, 0.f, -12.f}, {-2.f, 8.f, -11.f}, positions, indices);
+    add_box({4.f, 0.f, -20.f}, {40.f, 15.f, -19.f}, positions, indices);
+    add_box({-3.f, 0.f, -6.f}, {3.f, 3.f, -5.f}, positions, indices);
+    add_box({-100.f, -1.f, -100.f}, {100.f, 0.f, 100.f}, positions, indices);
+
+    std::mt19937 random;
+    std::uniform_real_distribution<float> x(-60.f, 60.f);
+    std::uniform_real_distribution<float> y(0.f, 10.f);
+    std::uniform_real_distribution<float> z(-80.f, -2.f);
+    std::uniform_real_distribution<float> size(0.2f, 2.f);
+
+    std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+    for (int i = 0; i < 100000; ++i)
+    {
+        glm::vec3 const min{x(random), y(random), z(random)};
+        boxes.push_back({min, min + glm::vec3(size(random), size(random), size(random))});
+    }
+
+    glm::mat4 const view = glm::lookAt(glm::vec3(0.f, 2.f, 0.f), glm::vec3(0.f, 2.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, 2.f, 0.1f, 200.f);
+    glm::mat4 const view_projection = projection * view;
+
+    thread_pool pool;
+    occlusion_buffer buffer;
+
+    std::cout << "SIMD rasterizer: " << (occlusion_simd_enabled() ? "AVX2" : "disabled") << ", threads: " << pool.size()
+        << ", buffer: " << buffer.width() << "x" << buffer.height() << ", occluder triangles: " << indices.size() / 3 << std::endl;
+
+    double const raster_time = measure([&]{ buffer.clear(); buffer.draw_occluder(view_projection, positions, indices); });
+    double const threaded_raster_time = measure([&]{ buffer.clear(); buffer.draw_occluder(view_projection, positions, indices, &pool); });
+    double const hierarchy_time = measure([&]{ buffer.build_hierarchy(); });
+
+    std::size_t hidden = 0;
+    double const test_time = measure([&]{
+        hidden = 0;
+        for (auto const & [min, max] : boxes)
+            hidden += !buffer.visible(view_projection, min, max);
+    });
+
+    // A hidden box must be behind the occluders at every pixel it touches
+    std::size_t errors = 0;
+    auto const & depth = buffer.levels[0];
+    for (auto const & [min, max] : boxes)
+    {
+        if (buffer.visible(view_projection, min, max)) continue;
+
+        glm::vec3 window_min(1e9f), window_max(-1e9f);
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 const c = view_projection * glm::vec4((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.f);
+            glm::vec3 const w = glm::vec3(c) / c.w * 0.5f + 0.5f;
+            window_min = glm::min(window_min, w);
+            window_max = glm::max(window_max, w);
+        }
+
+        int const x0 = std::max(0, int(std::floor(window_min.x * depth.width)));
+        int const x1 = std::min(depth.width - 1, int(std::floor(window_max.x * depth.width)));
+        int const y0 = std::max(0, int(std::floor(window_min.y * depth.height)));
+        int const y1 = std::min(depth.height - 1, int(std::floor(window_max.y * depth.height)));
+
+        bool behind = true;
+        for (int py = y0; py <= y1; ++py)
+            for (int px = x0; px <= x1; ++px)
+                behind = behind && (window_min.z > depth.max_depth[py * depth.width + px]);
+        errors += !behind;
+    }
+
+    // The buffer has a low resolution, so a hidden box must also be behind
+    // the occluder geometry itself: no point of a grid on its faces that is
+    // in view may be seen from the eye. This catches boxes showing past a
+    // silhouette by less than a texel, which the depth buffer can't
+    std::atomic<std::size_t> geometry_errors{0};
+    glm::vec3 const eye = glm::inverse(view)[3];
+    pool.parallel_for(boxes.size(), 256, [&](std::size_t begin, std::size_t end)
+    {
+        static constexpr int grid = 8;
+
+        std::size_t local_errors = 0;
+        for (std::size_t b = begin; b < end; ++b)
+        {
+            auto const & [min, max] = boxes[b];
+            if (buffer.visible(view_projection, min, max)) continue;
+
+            bool seen = false;
+            for (int axis = 0; axis < 3 && !seen; ++axis)
+                for (float side : {0.f, 1.f})
+                    for (int i = 0; i <= grid && !seen; ++i)
+                        for (int j = 0; j <= grid && !seen; ++j)
+                        {
+                            glm::vec3 t;
+                            t[axis] = side;
+                            t[(axis + 1) % 3] = float(i) / grid;
+                            t[(axis + 2) % 3] = float(j) / grid;
+                            glm::vec3 const p = glm::mix(min, max, t);
+                            glm::vec4 const c = view_projection * glm::vec4(p, 1.f);
+                            bool const in_view = std::abs(c.x) <= c.w && std::abs(c.y) <= c.w && std::abs(c.z) <= c.w;
+                            seen = in_view && !occluded(eye, p, positions, indices);
+                        }
+
+            local_errors += seen;
+        }
+
+        geometry_errors += local_errors;
+    });
+
+    std::cout << std::left << std::setw(32) << "rasterize, 1 thread, ms" << raster_time * 1e3 << std::endl;
+    std::cout << std::left << std::setw(32) << "rasterize, pool, ms" << threaded_raster_time * 1e3 << std::endl;
+    std::cout << std::left << std::setw(32) << "build hierarchy, ms" << hierarchy_time * 1e3 << std::endl;
+    std::cout << std::left << std::setw(32) << "test boxes, ms" << test_time * 1e3 << " (" << boxes.size() / test_time * 1e-6 << " Mboxes/s)" << std::endl;
+    std::cout << "Hidden boxes: " << hidden << " of " << boxes.size() << ", wrongly hidden: " << errors << " by the depth buffer, "
+        << geometry_errors << " by the geometry" << std::endl;
+}
@@ -0,0 +1,190 @@
+#include "occlusion_queries.hpp"
+
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+static glm::vec3 const cube_vertices[]
+{
+	{0.f, 0.f, 0.f},
+	{1.f, 0.f, 0.f},
+	{0.f, 1.f, 0.f},
+	{1.f, 1.f, 0.f},
+	{0.f, 0.f, 1.f},
+	{1.f, 0.f, 1.f},
+	{0.f, 1.f, 1.f},
+	{1.f, 1.f, 1.f},
+};
+
+static std::uint8_t const cube_indices[]
+{
+	// -Z
+	0, 2, 1,
+	1, 2, 3,
+	// +Z
+	4, 5, 6,
+	6, 5, 7,
+	// -Y
+	0, 1, 4,
+	4, 1, 5,
+	// +Y
+	2, 6, 3,
+	3, 6, 7,
+	// -X
+	0, 4, 2,
+	2, 4, 6,
+	// +X
+	1, 3, 5,
+	5, 3, 7,
+};
+
+occlusion_queries::occlusion_queries(GLuint box_program, std::size_t object_count, int retest_interval)
+	: box_program_(box_program)
+	, view_projection_location_(glGetUniformLocation(box_program, "view_projection"))
+	, box_min_location_(glGetUniformLocation(box_program, "box_min"))
+	, box_max_location_(glGetUniformLocation(box_program, "box_max"))
+	, retest_interval_(std::max(retest_interval, 1))
+	, objects_(object_count)
+{
+	glGenVertexArrays(1, &box_vao_);
+	glBindVertexArray(box_vao_);
+
+	glGenBuffers(1, &box_vbo_);
+	glBindBuffer(GL_ARRAY_BUFFER, box_vbo_);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &box_ebo_);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, box_ebo_);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glBindVertexArray(0);
+
+	for (auto & object : objects_)
+		glGenQueries(1, &object.query);
+}
+
+// Whether some corner of the box is behind the near plane: its faces are
+// clipped and may leave no samples even though the box is right in front of
+// the camera
+static bool crosses_near_plane(glm::mat4 const & view_projection, glm::vec3 const & min, glm::vec3 const & max)
+{
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec4 const corner = view_projection * glm::vec4(
+			(i & 1) ? max.x : min.x,
+			(i & 2) ? max.y : min.y,
+			(i & 4) ? max.z : min.z,
+			1.f);
+
+		if (corner.z < -corner.w)
+			return true;
+	}
+	return false;
+}
+
+occlusion_queries::stats occlusion_queries::render(glm::mat4 const & view_projection, box_set const & boxes,
+	std::span<std::uint32_t const> objects, std::function<void(std::uint32_t)> const & draw)
+{
+	++frame_;
+
+	stats result;
+	retested_.clear();
+
+	for (std::uint32_t i : objects)
+	{
+		auto & object = objects_[i];
+
+		if (object.pending)
+		{
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint samples = 0;
+				glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &samples);
+				object.visible = (samples != 0);
+				object.pending = false;
+			}
+		}
+
+		// Nothing is known about an object that has just entered the frustum
+		if (object.last_frame + 1 < frame_)
+			object.visible = true;
+		object.last_frame = frame_;
+
+		if (!object.visible && crosses_near_plane(view_projection, boxes.min(i), boxes.max(i)))
+			object.visible = true;
+
+		if (object.visible)
+		{
+			// A query is reused only once its result has been read
+			if (!object.pending)
+			{
+				glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+				draw(i);
+				glEndQuery(GL_ANY_SAMPLES_PASSED);
+				object.pending = true;
+			}
+			else
+				draw(i);
+
+			++result.drawn;
+		}
+		else if (!object.pending && (i + frame_) % retest_interval_ == 0)
+			retested_.push_back(i);
+		else
+			++result.skipped;
+	}
+
+	if (retested_.empty())
+		return result;
+
+	// The boxes go after all the visible objects, which are the likely
+	// occluders, and must not change the picture
+	GLint program = 0;
+	GLint vao = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	glUseProgram(box_program_);
+	glUniformMatrix4fv(view_projection_location_, 1, GL_FALSE, reinterpret_cast<float const *>(&view_projection));
+	glBindVertexArray(box_vao_);
+
+	for (std::uint32_t i : retested_)
+	{
+		glm::vec3 const min = boxes.min(i);
+		glm::vec3 const max = boxes.max(i);
+		glUniform3fv(box_min_location_, 1, reinterpret_cast<float const *>(&min));
+		glUniform3fv(box_max_location_, 1, reinterpret_cast<float const *>(&max));
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, objects_[i].query);
+		glDrawElements(GL_TRIANGLES, std::size(cube_indices), GL_UNSIGNED_BYTE, nullptr);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		objects_[i].pending = true;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	glUseProgram(program);
+	glBindVertexArray(vao);
+
+	// The GPU skips the draws whose boxes had no samples; with NO_WAIT it
+	// may draw anyway if the result isn't ready, which is only slower
+	for (std::uint32_t i : retested_)
+	{
+		glBeginConditionalRender(objects_[i].query, GL_QUERY_NO_WAIT);
+		draw(i);
+		glEndConditionalRender();
+	}
+
+	result.tested = retested_.size();
+	return result;
+}
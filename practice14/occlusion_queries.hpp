@@ -0,0 +1,71 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "culling.hpp"
+
+// Occlusion culling with hardware occlusion queries that never waits for the
+// GPU: an object is drawn or skipped according to the latest query result
+// that is already available, which is usually the previous frame's one.
+//
+// The query of an object that was visible is wrapped around its normal
+// draw, so it costs nothing extra. A hidden object is retested every
+// retest_interval frames, with the interval staggered over the objects: its
+// bounding box is drawn with color and depth writes disabled inside a query,
+// and the object itself is drawn with conditional rendering on that query,
+// so the GPU decides whether it shows up in this very frame and nothing pops
+// in late.
+struct occlusion_queries
+{
+	struct stats
+	{
+		std::size_t drawn = 0;
+		std::size_t skipped = 0;
+		// Hidden objects whose boxes were tested this frame
+		std::size_t tested = 0;
+	};
+
+	// The box program draws the unit cube scaled to the box_min .. box_max
+	// uniforms and transformed by view_projection
+	occlusion_queries(GLuint box_program, std::size_t object_count, int retest_interval = 4);
+
+	// Draws the objects that may be visible with the program that is
+	// bound, `draw` issues the draw call of an object. The objects are the
+	// indices of the boxes that passed frustum culling. Never waits for a
+	// query result; the depth test must be enabled.
+	stats render(glm::mat4 const & view_projection, box_set const & boxes,
+		std::span<std::uint32_t const> objects, std::function<void(std::uint32_t)> const & draw);
+
+private:
+	struct object_state
+	{
+		GLuint query = 0;
+		// The query was issued and its result wasn't read yet
+		bool pending = false;
+		bool visible = true;
+		// The last frame the object was drawn or tested in
+		std::uint64_t last_frame = 0;
+	};
+
+	GLuint box_program_;
+	GLint view_projection_location_;
+	GLint box_min_location_;
+	GLint box_max_location_;
+
+	GLuint box_vao_;
+	GLuint box_vbo_;
+	GLuint box_ebo_;
+
+	int retest_interval_;
+	std::uint64_t frame_ = 0;
+	std::vector<object_state> objects_;
+	std::vector<std::uint32_t> retested_;
+};
@@ -0,0 +1,138 @@
+#include "scene_graph.hpp"
+
+#include <algorithm>
+
+scene_graph::scene_graph(std::vector<gltf_model::node> const & nodes)
+{
+	std::vector<std::vector<std::uint32_t>> children(nodes.size());
+	std::vector<std::uint32_t> roots;
+	for (std::uint32_t i = 0; i < nodes.size(); ++i)
+	{
+		if (nodes[i].parent < 0)
+			roots.push_back(i);
+		else
+			children[nodes[i].parent].push_back(i);
+	}
+
+	node_index.assign(nodes.size(), no_parent);
+
+	// Depth-first traversal with an explicit stack, so that deep hierarchies
+	// don't overflow the call stack
+	std::vector<std::uint32_t> stack(roots.rbegin(), roots.rend());
+	while (!stack.empty())
+	{
+		std::uint32_t const source = stack.back();
+		stack.pop_back();
+
+		auto const & node = nodes[source];
+		std::uint32_t const index = source_node.size();
+
+		node_index[source] = index;
+		source_node.push_back(source);
+		parent.push_back(node.parent < 0 ? no_parent : node_index[node.parent]);
+		translation.push_back(node.translation);
+		rotation.push_back(node.rotation);
+		scale.push_back(node.scale);
+
+		stack.insert(stack.end(), children[source].rbegin(), children[source].rend());
+	}
+
+	// Subtrees end where the next node outside of them starts, which is
+	// found by walking the nodes backwards and extending the parents
+	subtree_end.resize(size());
+	for (std::uint32_t i = size(); i-- > 0;)
+	{
+		subtree_end[i] = std::max(subtree_end[i], i + 1);
+		if (parent[i] != no_parent)
+			subtree_end[parent[i]] = std::max(subtree_end[parent[i]], subtree_end[i]);
+	}
+
+	local_matrix.resize(size());
+	world_matrix.resize(size());
+
+	// Every local matrix has to be computed once, the roots cover all nodes
+	dirty_.assign(size(), 1);
+	for (std::uint32_t root : roots)
+		dirty_nodes_.push_back(node_index[root]);
+	update();
+}
+
+void scene_graph::set_translation(std::uint32_t node, glm::vec3 const & value)
+{
+	translation[node] = value;
+	mark_dirty(node);
+}
+
+void scene_graph::set_rotation(std::uint32_t node, glm::quat const & value)
+{
+	rotation[node] = value;
+	mark_dirty(node);
+}
+
+void scene_graph::set_scale(std::uint32_t node, glm::vec3 const & value)
+{
+	scale[node] = value;
+	mark_dirty(node);
+}
+
+void scene_graph::mark_dirty(std::uint32_t node)
+{
+	if (dirty_[node]) return;
+
+	dirty_[node] = 1;
+	dirty_nodes_.push_back(node);
+}
+
+std::size_t scene_graph::update()
+{
+	if (dirty_nodes_.empty())
+		return 0;
+
+	std::size_t updated = 0;
+	std::uint32_t updated_end = 0;
+
+	auto update_subtree = [&](std::uint32_t root)
+	{
+		// In depth-first order, a dirty node that lies inside an already
+		// updated subtree has been handled together with it
+		if (root < updated_end) return;
+
+		for (std::uint32_t i = root; i < subtree_end[root]; ++i)
+		{
+			if (dirty_[i])
+			{
+				// T * R * S without the full matrix products
+				glm::mat3 const r = glm::toMat3(rotation[i]);
+				local_matrix[i] = glm::mat4(
+					glm::vec4(r[0] * scale[i].x, 0.f),
+					glm::vec4(r[1] * scale[i].y, 0.f),
+					glm::vec4(r[2] * scale[i].z, 0.f),
+					glm::vec4(translation[i], 1.f));
+				dirty_[i] = 0;
+			}
+
+			world_matrix[i] = (parent[i] == no_parent) ? local_matrix[i] : world_matrix[parent[i]] * local_matrix[i];
+		}
+
+		updated += subtree_end[root] - root;
+		updated_end = subtree_end[root];
+	};
+
+	// Visiting the dirty nodes in order needs sorting them, which is slower
+	// than scanning all the flags once a few percent of the scene moves
+	if (dirty_nodes_.size() * 64 < size())
+	{
+		std::sort(dirty_nodes_.begin(), dirty_nodes_.end());
+		for (std::uint32_t root : dirty_nodes_)
+			update_subtree(root);
+	}
+	else
+	{
+		for (std::uint32_t i = 0; i < size(); ++i)
+			if (dirty_[i])
+				update_subtree(i);
+	}
+
+	dirty_nodes_.clear();
+	return updated;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A transform hierarchy flattened into arrays.
+//
+// Nodes are stored in depth-first order, so a parent always comes before its
+// children and the subtree of node i is the contiguous range
+// [i, subtree_end[i]). Changing a local transform only marks the node as
+// dirty; update() then recomputes the world matrices of the dirty subtrees
+// in a single forward pass and leaves the rest of the scene untouched.
+struct scene_graph
+{
+	static constexpr std::uint32_t no_parent = -1;
+
+	std::vector<std::uint32_t> parent;
+	std::vector<std::uint32_t> subtree_end;
+
+	std::vector<glm::vec3> translation;
+	std::vector<glm::quat> rotation;
+	std::vector<glm::vec3> scale;
+
+	std::vector<glm::mat4> local_matrix;
+	std::vector<glm::mat4> world_matrix;
+
+	// The glTF node each node was created from, and vice versa
+	std::vector<std::uint32_t> source_node;
+	std::vector<std::uint32_t> node_index;
+
+	scene_graph() = default;
+	explicit scene_graph(std::vector<gltf_model::node> const & nodes);
+
+	std::size_t size() const { return parent.size(); }
+
+	void set_translation(std::uint32_t node, glm::vec3 const & value);
+	void set_rotation(std::uint32_t node, glm::quat const & value);
+	void set_scale(std::uint32_t node, glm::vec3 const & value);
+
+	// Recomputes the matrices of the dirty subtrees, returns the number of
+	// world matrices that were recomputed
+	std::size_t update();
+
+private:
+	std::vector<std::uint8_t> dirty_;
+	std::vector<std::uint32_t> dirty_nodes_;
+
+	void mark_dirty(std::uint32_t node);
+};
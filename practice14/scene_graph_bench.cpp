@@ -0,0 +1,80 @@
+// Headless scene graph benchmark: builds a large random hierarchy and moves
+// a small fraction of its nodes every frame, comparing the incremental
+// update against recomputing every world matrix.
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+#include "benchmark.hpp"
+#include "scene_graph.hpp"
+
+// Many objects of a few dozen nodes each, every node attached to a random
+// earlier node of its object, like the props and characters of a level
+static std::vector<gltf_model::node> make_hierarchy(std::size_t count, std::mt19937 & random)
+{
+    std::vector<gltf_model::node> result(count);
+
+    std::uniform_real_distribution<float> offset(-1.f, 1.f);
+    std::size_t object_root = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (random() % 32 == 0)
+            object_root = i;
+        else if (i > object_root)
+            result[i].parent = object_root + random() % (i - object_root);
+
+        result[i].translation = {offset(random), offset(random), offset(random)};
+        result[i].rotation = glm::angleAxis(offset(random), glm::vec3(0.f, 1.f, 0.f));
+    }
+
+    return result;
+}
+
+int main()
+{
+    std::mt19937 random(42);
+
+    std::cout << std::left << std::setw(12) << "nodes"
+        << std::setw(12) << "moved, %"
+        << std::setw(20) << "updated per frame"
+        << std::setw(20) << "incremental, ms"
+        << "full, ms" << std::endl;
+
+    for (std::size_t count : {10000, 100000, 1000000})
+    {
+        scene_graph scene(make_hierarchy(count, random));
+
+        for (float fraction : {0.01f, 0.05f})
+        {
+            std::size_t const moved = count * fraction;
+            std::uniform_int_distribution<std::uint32_t> node(0, count - 1);
+
+            std::size_t updated = 0;
+            std::size_t frames = 0;
+
+            double const incremental_time = measure([&]{
+                for (std::size_t i = 0; i < moved; ++i)
+                {
+                    auto const n = node(random);
+                    scene.set_translation(n, scene.translation[n] + glm::vec3(0.f, 0.01f, 0.f));
+                }
+                updated += scene.update();
+                ++frames;
+            });
+
+            double const full_time = measure([&]{
+                for (std::uint32_t i = 0; i < scene.size(); ++i)
+                    if (scene.parent[i] == scene_graph::no_parent)
+                        scene.set_scale(i, scene.scale[i]);
+                scene.update();
+            });
+
+            std::cout << std::left << std::setw(12) << count
+                << std::setw(12) << fraction * 100.f
+                << std::setw(20) << updated / frames
+                << std::setw(20) << incremental_time * 1e3
+                << full_time * 1e3 << std::endl;
+        }
+    }
+}
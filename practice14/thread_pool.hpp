@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads executing tasks from a shared queue
+struct thread_pool
+{
+    explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool & operator = (thread_pool const &) = delete;
+
+    std::size_t size() const { return threads_.size(); }
+
+    void submit(std::function<void()> task);
+
+    // Calls f(begin, end) for consecutive chunks of [0, count) on the worker
+    // threads and on the calling thread; returns when all chunks are done
+    void parallel_for(std::size_t count, std::size_t chunk_size, std::function<void(std::size_t, std::size_t)> const & f);
+
+private:
+    std::vector<std::thread> threads_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopped_ = false;
+
+    void work();
+};
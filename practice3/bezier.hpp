@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace practice3
+{
+
+struct vec2
+{
+    float x;
+    float y;
+};
+
+struct vertex
+{
+    vec2 position;
+    std::uint8_t color[4];
+};
+
+inline vec2 bezier(std::vector<vertex> const & vertices, float t)
+{
+    std::vector<vec2> points(vertices.size());
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+        points[i] = vertices[i].position;
+
+    // De Casteljau's algorithm
+    for (std::size_t k = 0; k + 1 < vertices.size(); ++k) {
+        for (std::size_t i = 0; i + k + 1 < vertices.size(); ++i) {
+            points[i].x = points[i].x * (1.f - t) + points[i + 1].x * t;
+            points[i].y = points[i].y * (1.f - t) + points[i + 1].y * t;
+        }
+    }
+    return points[0];
+}
+
+}
@@ -13,6 +13,12 @@
 #include <chrono>
 #include <vector>
 
+#include "bezier.hpp"
+
+using practice3::vec2;
+using practice3::vertex;
+using practice3::bezier;
+
 std::string to_string(std::string_view str)
 {
     return std::string(str.begin(), str.end());
@@ -97,35 +103,6 @@ GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
     return result;
 }
 
-struct vec2
-{
-    float x;
-    float y;
-};
-
-struct vertex
-{
-    vec2 position;
-    std::uint8_t color[4];
-};
-
-vec2 bezier(std::vector<vertex> const & vertices, float t)
-{
-    std::vector<vec2> points(vertices.size());
-
-    for (std::size_t i = 0; i < vertices.size(); ++i)
-        points[i] = vertices[i].position;
-
-    // De Casteljau's algorithm
-    for (std::size_t k = 0; k + 1 < vertices.size(); ++k) {
-        for (std::size_t i = 0; i + k + 1 < vertices.size(); ++i) {
-            points[i].x = points[i].x * (1.f - t) + points[i + 1].x * t;
-            points[i].y = points[i].y * (1.f - t) + points[i + 1].y * t;
-        }
-    }
-    return points[0];
-}
-
 int main() try
 {
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -27,6 +27,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow_culling.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -273,6 +274,10 @@ int main() try
     std::string scene_path = project_root + "/bunny.obj";
     obj_data scene = parse_obj(scene_path);
 
+    // Parts of the scene that are culled separately in the shadow pass
+    std::vector<caster_chunk> const chunks = split_into_chunks(scene, 8);
+    std::vector<std::uint32_t> casters;
+
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
@@ -322,6 +327,9 @@ int main() try
     float view_elevation = glm::radians(45.f);
     float view_azimuth = 0.f;
     float camera_distance = 1.5f;
+
+    float last_stats_time = 0.f;
+
     bool running = true;
     while (running)
     {
@@ -372,6 +380,17 @@ int main() try
 
         glm::mat4 model(1.f);
 
+        float near = 0.01f;
+        float far = 10.f;
+
+        glm::mat4 view(1.f);
+        view = glm::translate(view, {0.f, 0.f, -camera_distance});
+        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
+        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
+
+        glm::mat4 projection = glm::mat4(1.f);
+        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+
         glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time * 0.5f), 1.f, std::sin(time * 0.5f)));
 
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
@@ -401,8 +420,20 @@ int main() try
         glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
 
+        // Only the chunks that can shadow something in view; both transforms
+        // take the chunks from model space
+        casters.clear();
+        cull_shadow_casters(transform * model, projection * view * model, chunks, casters);
+
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (std::uint32_t i : casters)
+            glDrawElements(GL_TRIANGLES, chunks[i].index_count, GL_UNSIGNED_INT, reinterpret_cast<void *>(chunks[i].first_index * sizeof(std::uint32_t)));
+
+        if (time - last_stats_time > 1.f)
+        {
+            last_stats_time = time;
+            std::cout << "Shadow casters: " << casters.size() << " of " << chunks.size() << " chunks" << std::endl;
+        }
 
         glBindTexture(GL_TEXTURE_2D, shadow_map);
         glGenerateMipmap(GL_TEXTURE_2D);
@@ -419,17 +450,6 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        float near = 0.01f;
-        float far = 10.f;
-
-        glm::mat4 view(1.f);
-        view = glm::translate(view, {0.f, 0.f, -camera_distance});
-        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
-        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
-
-        glm::mat4 projection = glm::mat4(1.f);
-        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
-
         glBindTexture(GL_TEXTURE_2D, shadow_map);
 
         glUseProgram(program);
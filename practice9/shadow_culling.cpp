@@ -0,0 +1,164 @@
+#include "shadow_culling.hpp"
+
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vector_relational.hpp>
+
+#include <algorithm>
+#include <limits>
+
+std::vector<caster_chunk> split_into_chunks(obj_data & data, int cells_per_axis)
+{
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+
+    auto position = [&](std::uint32_t index)
+    {
+        auto const & p = data.vertices[index].position;
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    for (auto const & v : data.vertices)
+    {
+        min = glm::min(min, glm::vec3(v.position[0], v.position[1], v.position[2]));
+        max = glm::max(max, glm::vec3(v.position[0], v.position[1], v.position[2]));
+    }
+
+    // Every triangle goes to the cell of its centroid
+    std::size_t const triangle_count = data.indices.size() / 3;
+    std::vector<std::uint32_t> cell(triangle_count);
+    glm::vec3 const cell_size = glm::max((max - min) / float(cells_per_axis), glm::vec3(1e-6f));
+
+    for (std::size_t t = 0; t < triangle_count; ++t)
+    {
+        glm::vec3 const centroid = (position(data.indices[3 * t]) + position(data.indices[3 * t + 1]) + position(data.indices[3 * t + 2])) / 3.f;
+        glm::ivec3 const c = glm::clamp(glm::ivec3((centroid - min) / cell_size), glm::ivec3(0), glm::ivec3(cells_per_axis - 1));
+        cell[t] = (c.z * cells_per_axis + c.y) * cells_per_axis + c.x;
+    }
+
+    std::vector<std::uint32_t> order(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        order[t] = t;
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return cell[a] < cell[b]; });
+
+    std::vector<std::uint32_t> indices;
+    indices.reserve(data.indices.size());
+    std::vector<caster_chunk> chunks;
+
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        std::uint32_t const t = order[i];
+        if (i == 0 || cell[t] != cell[order[i - 1]])
+        {
+            chunks.push_back({static_cast<std::uint32_t>(indices.size()), 0,
+                glm::vec3(std::numeric_limits<float>::infinity()), glm::vec3(-std::numeric_limits<float>::infinity())});
+        }
+
+        auto & chunk = chunks.back();
+        for (int k = 0; k < 3; ++k)
+        {
+            std::uint32_t const index = data.indices[3 * t + k];
+            indices.push_back(index);
+            chunk.min = glm::min(chunk.min, position(index));
+            chunk.max = glm::max(chunk.max, position(index));
+        }
+        chunk.index_count += 3;
+    }
+
+    data.indices = std::move(indices);
+    return chunks;
+}
+
+namespace
+{
+
+    struct box
+    {
+        glm::vec3 min{std::numeric_limits<float>::infinity()};
+        glm::vec3 max{-std::numeric_limits<float>::infinity()};
+
+        void add(glm::vec3 const & p)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+    };
+
+    // Bounds of the corners of the cube [min, max] transformed by m, with
+    // the perspective division
+    box transform_box(glm::mat4 const & m, glm::vec3 const & min, glm::vec3 const & max)
+    {
+        box result;
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 const p = m * glm::vec4(
+                (i & 1) ? max.x : min.x,
+                (i & 2) ? max.y : min.y,
+                (i & 4) ? max.z : min.z,
+                1.f);
+            result.add(glm::vec3(p) / p.w);
+        }
+        return result;
+    }
+
+}
+
+void cull_shadow_casters(glm::mat4 const & light_transform, glm::mat4 const & camera_view_projection,
+    std::vector<caster_chunk> const & chunks, std::vector<std::uint32_t> & casters)
+{
+    // The corners of the camera frustum, which is the NDC cube seen from
+    // the world, taken to light space one by one: the world space box around
+    // them would be much larger
+    box receivers = transform_box(light_transform * glm::inverse(camera_view_projection), glm::vec3(-1.f), glm::vec3(1.f));
+
+    // Nothing outside of the shadow map receives a shadow from it
+    receivers.min = glm::max(receivers.min, glm::vec3(-1.f));
+    receivers.max = glm::min(receivers.max, glm::vec3(1.f));
+    if (glm::any(glm::greaterThan(receivers.min, receivers.max)))
+        return;
+
+    // Extruded towards the light, which is at -z
+    receivers.min.z = -1.f;
+
+    // The box is loose when the frustum is seen at an angle from the light.
+    // The frustum planes that face the light also bound the extruded
+    // frustum, since moving towards the light only takes a point further
+    // inside them; the others are dropped
+    glm::vec3 const to_light = glm::vec3(glm::inverse(light_transform) * glm::vec4(0.f, 0.f, -1.f, 0.f));
+
+    auto row = [&](int i)
+    {
+        return glm::vec4(camera_view_projection[0][i], camera_view_projection[1][i], camera_view_projection[2][i], camera_view_projection[3][i]);
+    };
+
+    std::vector<glm::vec4> planes;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (glm::vec4 const plane : {row(3) + row(i), row(3) - row(i)})
+        {
+            if (glm::dot(glm::vec3(plane), to_light) >= 0.f)
+                planes.push_back(plane);
+        }
+    }
+
+    for (std::uint32_t i = 0; i < chunks.size(); ++i)
+    {
+        auto const & chunk = chunks[i];
+
+        box const caster = transform_box(light_transform, chunk.min, chunk.max);
+        bool const overlaps = glm::all(glm::lessThanEqual(caster.min, receivers.max)) && glm::all(glm::lessThanEqual(receivers.min, caster.max));
+        if (!overlaps)
+            continue;
+
+        // The corner of the box furthest along the plane normal
+        bool const behind_plane = std::any_of(planes.begin(), planes.end(), [&](glm::vec4 const & plane)
+        {
+            glm::vec3 const corner = glm::mix(chunk.min, chunk.max, glm::vec3(glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.f))));
+            return glm::dot(glm::vec3(plane), corner) + plane.w < 0.f;
+        });
+
+        if (!behind_plane)
+            casters.push_back(i);
+    }
+}
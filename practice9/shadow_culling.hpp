@@ -0,0 +1,37 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A range of the index buffer whose triangles lie close together, drawn
+// and culled as one shadow caster
+struct caster_chunk
+{
+    std::uint32_t first_index;
+    std::uint32_t index_count;
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Sorts the triangles into a grid of cells over the bounds of the mesh and
+// returns the non-empty cells as chunks; reorders data.indices
+std::vector<caster_chunk> split_into_chunks(obj_data & data, int cells_per_axis);
+
+// Appends the indices of the chunks that may cast a shadow onto something
+// the camera sees.
+//
+// light_transform is the orthographic shadow map transform to [-1, 1]^3,
+// with the light looking along +z. The receivers that matter are the
+// part of the camera frustum inside that volume; a caster shades them only
+// if it overlaps them in light space x and y, and lies between them and
+// the light in z. So the receiver bounds are extruded towards the light up
+// to the near plane of the shadow volume and the casters are tested
+// against the result, and against the frustum planes facing the light,
+// which bound the extruded frustum as well.
+void cull_shadow_casters(glm::mat4 const & light_transform, glm::mat4 const & camera_view_projection,
+    std::vector<caster_chunk> const & chunks, std::vector<std::uint32_t> & casters);